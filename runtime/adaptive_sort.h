@@ -0,0 +1,133 @@
+// Adaptive entry point for 32-bit keys. A sampled probe looks at how
+// presorted the input is and how many distinct keys it has, and sends it
+// to the algorithm that does best on that kind of input:
+//   long runs or nearly (reverse) sorted  -> timSort, which merges the runs
+//   few distinct keys over a wide range   -> introSort, whose 3-way
+//                                            partition retires a key per pass
+//   everything else                       -> radix_sort (counting sort when
+//                                            the key range is narrow)
+// Small inputs skip the probe and go straight to introSort.
+#ifndef ADAPTIVE_SORT_H
+#define ADAPTIVE_SORT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include <algorithm>
+#include "intro_sort.h"
+#include "radix_sort.h"
+#include "timsort.h"
+
+// Inputs shorter than this are sorted without probing
+#define ADAPTIVE_MIN_LENGTH (1 << 12)
+// The probe reads this many blocks of consecutive keys for the run count...
+#define PROBE_BLOCKS 64
+#define PROBE_BLOCK_LEN 256
+// ...and this many random pairs for the inversions and distinct keys
+#define PROBE_PAIRS 128
+// Average run length (in keys) above which timSort is used outright
+#define ADAPTIVE_LONG_RUN 64
+// Runs this long are enough if nearly every pair is also in order
+#define ADAPTIVE_SHORT_RUN 8
+#define ADAPTIVE_MAX_DISORDER 0.02
+// Samples with at most this many distinct keys go to the 3-way quicksort;
+// radix_sort is faster from about four wide keys up
+#define ADAPTIVE_FEW_DISTINCT 3
+
+// What the probe measured on a sample of the input
+struct sortedness_probe {
+    double avgRun;          // Estimated keys per ascending or descending run
+    double inversions;      // Fraction of sampled pairs out of order (0.5 = random)
+    unsigned distinct;      // Distinct keys among the 2 * PROBE_PAIRS sampled
+    int32_t sampleMin;      // Smallest and largest sampled key
+    int32_t sampleMax;
+};
+
+// What the last adaptive_sort call found and did, for the benchmark output
+struct adaptive_report {
+    const char* choice;
+    sortedness_probe probe;
+    double probeSeconds;
+};
+static adaptive_report adaptive_last_report;
+
+// Counts descents in PROBE_BLOCKS blocks spread evenly over
+// a[0..n), then compares PROBE_PAIRS pairs at pseudo-random positions.
+// Reads about 16K keys whatever n is.
+static inline sortedness_probe probe_sortedness(const int32_t* a, size_t n) {
+    sortedness_probe probe;
+
+    uint64_t descents = 0, steps = 0;
+    size_t const blockLen = std::min<size_t>(PROBE_BLOCK_LEN, n / PROBE_BLOCKS);
+    for (size_t b = 0; b < PROBE_BLOCKS; b++) {
+        const int32_t* block = a + (n - blockLen) * b / (PROBE_BLOCKS - 1);
+        for (size_t i = 0; i + 1 < blockLen; i++)
+            descents += block[i + 1] < block[i];
+        steps += blockLen - 1;
+    }
+
+    // Pairs come from a fixed xorshift sequence, so the same input always
+    // gets the same decision
+    int32_t sample[2 * PROBE_PAIRS];
+    uint64_t state = 0x9E3779B97F4A7C15ull ^ n;
+    unsigned inverted = 0;
+    for (unsigned p = 0; p < PROBE_PAIRS; p++) {
+        size_t pos[2];
+        for (int k = 0; k < 2; k++) {
+            state ^= state << 13;
+            state ^= state >> 7;
+            state ^= state << 17;
+            pos[k] = state % n;
+        }
+        size_t i = std::min(pos[0], pos[1]), j = std::max(pos[0], pos[1]);
+        inverted += a[i] > a[j];
+        sample[2 * p] = a[i];
+        sample[2 * p + 1] = a[j];
+    }
+    probe.inversions = (double)inverted / PROBE_PAIRS;
+
+    // Runs are measured the way timSort finds them: mostly ascending input
+    // breaks a run at every descent, mostly descending input at every step
+    // that isn't a strict descent (so reversed duplicates make short runs)
+    uint64_t const breaks = probe.inversions <= 0.5 ? descents : steps - descents;
+    probe.avgRun = (double)steps / (breaks + 1);
+
+    std::sort(sample, sample + 2 * PROBE_PAIRS);
+    probe.distinct = std::unique(sample, sample + 2 * PROBE_PAIRS) - sample;
+    probe.sampleMin = sample[0];
+    probe.sampleMax = sample[probe.distinct - 1];
+    return probe;
+}
+
+// Sorts a[0..n) with timSort, introSort or radix_sort, as the probe suggests
+static inline void adaptive_sort(int32_t* a, size_t n) {
+    if (n < ADAPTIVE_MIN_LENGTH) {
+        adaptive_last_report = adaptive_report{ "introSort (small)", sortedness_probe{ 0, 0, 0, 0, 0 }, 0 };
+        if (n > 1)
+            introSort(a, 0, n - 1);
+        return;
+    }
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    sortedness_probe probe = probe_sortedness(a, n);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    adaptive_last_report.probe = probe;
+    adaptive_last_report.probeSeconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    bool const nearlyOrdered = probe.inversions <= ADAPTIVE_MAX_DISORDER || probe.inversions >= 1 - ADAPTIVE_MAX_DISORDER;
+    if (probe.avgRun >= ADAPTIVE_LONG_RUN || (probe.avgRun >= ADAPTIVE_SHORT_RUN && nearlyOrdered)) {
+        adaptive_last_report.choice = "timSort";
+        timSort(a, n);
+    } else if (probe.distinct <= ADAPTIVE_FEW_DISTINCT && (uint32_t)probe.sampleMax - (uint32_t)probe.sampleMin >= COUNTING_SORT_MIN_RANGE) {
+        // A narrow key range is counting sorted even faster, so the
+        // quicksort only gets few keys that are spread out
+        adaptive_last_report.choice = "introSort";
+        introSort(a, 0, n - 1);
+    } else {
+        adaptive_last_report.choice = "radix_sort";
+        radix_sort(a, n);
+    }
+}
+
+#endif
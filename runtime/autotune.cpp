@@ -0,0 +1,336 @@
+// g++ -Wall -Wpedantic -march=haswell -O3 -pthread autotune.cpp -o autotune
+// ./autotune --size 1000000 --reps 5
+// Measures the thresholds in sort_tuning.h on this machine and writes them
+// to the profile the sorts load at startup. Each parameter is swept on its
+// own, starting from the defaults, on the inputs it matters for; the
+// template-selected ones (timSort's run, the introSort and merge_sort
+// cutoffs) go first, so the parallel sorts are tuned on top of them. Prints
+// every candidate's time and, per parameter, the gain over the default.
+// Get modern behaviour out of time.h, per https://stackoverflow.com/a/40515669
+#define _POSIX_C_SOURCE 199309L
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <functional>
+#include <thread>
+#include <vector>
+#include "sort_inputs.h"
+#include "sort_tuning.h"
+#include "sort_verify.h"
+#include "merge_sort.h"
+#include "quick_sort.h"
+#include "timsort.h"
+#include "radix_sort.h"
+
+typedef std::function<void(int32_t*, size_t)> sort_fn;
+
+struct tune_config {
+    uint64_t size = 1 << 20;
+    uint64_t radixMaxSize = 1 << 24;
+    unsigned reps = 5;
+    unsigned threads = std::thread::hardware_concurrency();
+    unsigned seed = 1;
+    const char* outPath = NULL;
+};
+
+// One parameter's outcome, for the summary
+struct tune_result {
+    const char* name;
+    uint64_t defaultValue;
+    uint64_t tunedValue;
+    double defaultSeconds;
+    double tunedSeconds;
+    const char* note;
+};
+
+double elapsed_seconds(const struct timespec& start, const struct timespec& end) {
+    return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+// Sum over inputs of the median time of reps sorts, each of a fresh copy,
+// after one untimed warmup. Returns -1 if sort gets an input wrong.
+double time_sort(const sort_fn& sort, const std::vector<std::vector<int32_t>>& inputs, unsigned reps) {
+    double total = 0;
+    for (const std::vector<int32_t>& keys : inputs) {
+        std::vector<int32_t> work(keys.size());
+        verify_digest const digest = verify_fingerprint(keys.data(), keys.size());
+        std::vector<double> seconds;
+        for (unsigned rep = 0; rep <= reps; rep++) {
+            struct timespec start, end;
+            std::copy(keys.begin(), keys.end(), work.begin());
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            sort(work.data(), work.size());
+            clock_gettime(CLOCK_MONOTONIC, &end);
+            if (rep == 0) {
+                if (verify_sorted(work.data(), work.size(), digest) != VERIFY_OK)
+                    return -1;
+                continue;
+            }
+            seconds.push_back(elapsed_seconds(start, end));
+        }
+        std::sort(seconds.begin(), seconds.end());
+        total += seconds[seconds.size() / 2];
+    }
+    return total;
+}
+
+std::vector<std::vector<int32_t>> make_inputs(std::initializer_list<array_ordering> orders, uint64_t n, unsigned seed) {
+    std::vector<std::vector<int32_t>> inputs;
+    for (array_ordering order : orders) {
+        DATA_T* keys = create_array(n, order, seed);
+        if (keys == NULL)
+            exit(1);
+        inputs.emplace_back(keys, keys + n);
+        free(keys);
+    }
+    return inputs;
+}
+
+// Times sort_for(value) for every candidate value and keeps the fastest in
+// the field of sort_tuning_active. Returns false if a candidate sorts wrong.
+bool sweep(const char* name, uint64_t sort_tuning::*field, const std::vector<uint64_t>& candidates,
+           const std::function<sort_fn(uint64_t)>& sort_for, const std::vector<std::vector<int32_t>>& inputs,
+           const tune_config& config, std::vector<tune_result>* results) {
+    tune_result result = { name, sort_tuning_defaults().*field, 0, 0, 0, "" };
+    double best = -1;
+    for (uint64_t value : candidates) {
+        sort_tuning_active.*field = value;
+        double const seconds = time_sort(sort_for(value), inputs, config.reps);
+        if (seconds < 0) {
+            fprintf(stderr, "%s %lu left its input unsorted\n", name, value);
+            return false;
+        }
+        printf("  %-26s %10lu %10.2f ms\n", name, value, seconds * 1000);
+        if (value == result.defaultValue)
+            result.defaultSeconds = seconds;
+        if (best < 0 || seconds < best) {
+            best = seconds;
+            result.tunedValue = value;
+        }
+    }
+    result.tunedSeconds = best;
+    sort_tuning_active.*field = result.tunedValue;
+    results->push_back(result);
+    return true;
+}
+
+// Powers of two from 2^lo to 2^hi
+std::vector<uint64_t> powers_of_two(unsigned lo, unsigned hi) {
+    std::vector<uint64_t> values;
+    for (unsigned p = lo; p <= hi; p++)
+        values.push_back((uint64_t)1 << p);
+    return values;
+}
+
+// introSort with the given cutoff's instantiation
+sort_fn intro_sort_with(uint64_t cutoff) {
+    intro_sort_loop_fn const loop = introsort_for_cutoff(cutoff);
+    return [loop](int32_t* a, size_t n) {
+        int depthLimit = 0;
+        for (size_t m = n; m > 1; m >>= 1)
+            depthLimit += 2;
+        loop(a, 0, n - 1, depthLimit);
+    };
+}
+
+// merge_sort with the given base case's instantiation
+sort_fn merge_sort_with(uint64_t baseCase) {
+    merge_sort_into_fn const into = merge_sort_for_base_case(baseCase);
+    return [into](int32_t* a, size_t n) {
+        scratch_arena<int32_t> arena;
+        if (!arena_init(&arena, n))
+            return;
+        std::copy(a, a + n, arena.buffer);
+        into(arena.buffer, a, 0, n - 1);
+        arena_free(&arena);
+    };
+}
+
+// Digit width radix_digit_bits picks for n 32-bit keys under the thresholds
+unsigned radix_width(uint64_t n, uint64_t min11, uint64_t min16) {
+    return n >= min16 ? 16 : n >= min11 ? 11 : 8;
+}
+
+// The smallest measured size from which every larger one was fastest with
+// digits at least width bits wide. If none was, the threshold goes past the
+// largest size measured, unless it already was.
+uint64_t radix_threshold(const std::vector<uint64_t>& sizes, const std::vector<unsigned>& best, unsigned width, uint64_t current) {
+    size_t i = sizes.size();
+    while (i > 0 && best[i - 1] >= width)
+        i--;
+    if (i == sizes.size())
+        return current > sizes.back() ? current : sizes.back() * 2;
+    if (i == 0)
+        return std::min(current, sizes[0]);
+    return sizes[i];
+}
+
+// Times 8, 11 and 16-bit LSD radix passes on full-width keys at sizes up to
+// config.radixMaxSize and places both thresholds where the wider digits
+// start to win
+bool tune_radix(const tune_config& config, std::vector<tune_result>* results) {
+    static const unsigned widths[] = { 8, 11, 16 };
+    std::vector<uint64_t> sizes;
+    for (uint64_t n = 1 << 12; n <= config.radixMaxSize; n *= 4)
+        sizes.push_back(n);
+    if (sizes.empty())
+        return true;
+    std::vector<unsigned> best;
+    std::vector<double> seconds[3];
+    for (uint64_t n : sizes) {
+        std::vector<std::vector<int32_t>> inputs = make_inputs({ WIDE_RANDOM }, n, config.seed);
+        unsigned fastest = 0;
+        for (unsigned w = 0; w < 3; w++) {
+            unsigned const bits = widths[w];
+            double const s = time_sort([bits](int32_t* a, size_t m) { radix_sort_lsd(a, m, (int32_t)INT32_MIN, (int32_t)INT32_MAX, bits); },
+                                       inputs, config.reps);
+            if (s < 0) {
+                fprintf(stderr, "%u-bit radix sort left its input unsorted\n", bits);
+                return false;
+            }
+            seconds[w].push_back(s);
+            if (s < seconds[fastest].back())
+                fastest = w;
+            printf("  %-26s %10lu %7u-bit %8.2f ms\n", "radix keys", n, bits, s * 1000);
+        }
+        best.push_back(widths[fastest]);
+    }
+
+    sort_tuning const defaults = sort_tuning_defaults();
+    uint64_t const min11 = radix_threshold(sizes, best, 11, defaults.radix11BitMin);
+    uint64_t const min16 = std::max(min11, radix_threshold(sizes, best, 16, defaults.radix16BitMin));
+    // Both thresholds decide together which width runs at each size
+    double defaultTotal = 0, tunedTotal = 0;
+    for (size_t i = 0; i < sizes.size(); i++) {
+        unsigned const d = radix_width(sizes[i], defaults.radix11BitMin, defaults.radix16BitMin);
+        unsigned const t = radix_width(sizes[i], min11, min16);
+        defaultTotal += seconds[d == 8 ? 0 : d == 11 ? 1 : 2][i];
+        tunedTotal += seconds[t == 8 ? 0 : t == 11 ? 1 : 2][i];
+    }
+    sort_tuning_active.radix11BitMin = min11;
+    sort_tuning_active.radix16BitMin = min16;
+    results->push_back({ "radix_11_bit_min", defaults.radix11BitMin, min11, defaultTotal, tunedTotal, "with radix_16_bit_min" });
+    results->push_back({ "radix_16_bit_min", defaults.radix16BitMin, min16, defaultTotal, tunedTotal, "with radix_11_bit_min" });
+    return true;
+}
+
+void usage() {
+    printf("Usage: autotune [options]\n"
+           "  --size n           keys per input for the comparison sorts (default 1048576)\n"
+           "  --radix-max n      largest input for the radix digit widths (default 16777216)\n"
+           "  --reps n           timed runs per candidate and input, after one warmup\n"
+           "                     (default 5)\n"
+           "  --threads n        pool size the parallel grains are tuned for (default all\n"
+           "                     hardware threads); with 1 they keep their defaults\n"
+           "  --seed n           seed for the inputs (default 1)\n"
+           "  --out file         where to write the profile (default $SORT_TUNING_PROFILE\n"
+           "                     or sort_tuning.<hostname>.profile)\n");
+}
+
+bool parse_args(int argc, char* argv[], tune_config* config) {
+    for (int i = 1; i < argc; i++) {
+        const char* opt = argv[i];
+        if (strcmp(opt, "--help") == 0)
+            return false;
+        if (i + 1 >= argc) {
+            fprintf(stderr, "Missing value for %s\n", opt);
+            return false;
+        }
+        const char* value = argv[++i];
+        if (strcmp(opt, "--size") == 0) {
+            config->size = strtoull(value, NULL, 10);
+        } else if (strcmp(opt, "--radix-max") == 0) {
+            config->radixMaxSize = strtoull(value, NULL, 10);
+        } else if (strcmp(opt, "--reps") == 0) {
+            config->reps = atoi(value);
+        } else if (strcmp(opt, "--threads") == 0) {
+            config->threads = atoi(value);
+        } else if (strcmp(opt, "--seed") == 0) {
+            config->seed = atoi(value);
+        } else if (strcmp(opt, "--out") == 0) {
+            config->outPath = value;
+        } else {
+            fprintf(stderr, "Unknown option %s\n", opt);
+            return false;
+        }
+    }
+    if (config->size < 2 || config->reps < 1 || config->threads < 1) {
+        fprintf(stderr, "--size must be at least 2, --reps and --threads at least 1\n");
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    tune_config config;
+    if (!parse_args(argc, argv, &config)) {
+        usage();
+        return 1;
+    }
+    char defaultPath[256];
+    if (config.outPath == NULL) {
+        sort_tuning_default_path(defaultPath, sizeof(defaultPath));
+        config.outPath = defaultPath;
+    }
+
+    // Tune from the defaults, whatever profile is already there
+    sort_tuning_active = sort_tuning_defaults();
+    sort_tuning_loaded = true;
+    sort_pool_init(config.threads);
+
+    uint64_t const n = config.size;
+    std::vector<tune_result> results;
+    printf("%-28s %10s %10s\n", "parameter", "value", "time");
+
+    // Template-selected thresholds, each instantiation called directly
+    std::vector<uint64_t> const runs(tuning_runs, tuning_runs + sizeof(tuning_runs) / sizeof(tuning_runs[0]));
+    std::vector<uint64_t> const cutoffs(tuning_cutoffs, tuning_cutoffs + sizeof(tuning_cutoffs) / sizeof(tuning_cutoffs[0]));
+    std::vector<uint64_t> const baseCases(tuning_base_cases, tuning_base_cases + sizeof(tuning_base_cases) / sizeof(tuning_base_cases[0]));
+    bool ok = sweep("timsort_run", &sort_tuning::timsortRun, runs, [](uint64_t run) { return sort_fn(timsort_for_run(run)); },
+                    make_inputs({ RANDOM, WIDE_RANDOM, ALMOST_SORTED, PARTIALLY_SORTED, ZIPF }, n, config.seed), config, &results) &&
+              sweep("introsort_cutoff", &sort_tuning::introSortCutoff, cutoffs, intro_sort_with,
+                    make_inputs({ RANDOM, WIDE_RANDOM, MANY_DUPLICATE_VALUES, FEW_UNIQUE }, n, config.seed), config, &results) &&
+              sweep("merge_sort_base_case", &sort_tuning::mergeSortBaseCase, baseCases, merge_sort_with,
+                    make_inputs({ RANDOM, WIDE_RANDOM, ALMOST_SORTED }, n, config.seed), config, &results);
+    if (!ok)
+        return 1;
+
+    // The parallel sorts read their grain on every fork, and call the
+    // sequential sorts, which now pick up the tuned instantiations
+    sort_tuning const defaults = sort_tuning_defaults();
+    if (config.threads > 1) {
+        std::vector<std::vector<int32_t>> const inputs = make_inputs({ RANDOM, WIDE_RANDOM }, n, config.seed);
+        std::vector<uint64_t> const grains = powers_of_two(12, 18);
+        ok = sweep("parallel_merge_sort_grain", &sort_tuning::parallelMergeSortGrain, grains,
+                   [](uint64_t) { return sort_fn([](int32_t* a, size_t m) { parallel_merge_sort(a, 0, m - 1); }); }, inputs, config, &results) &&
+             sweep("parallel_quick_sort_grain", &sort_tuning::parallelQuickSortGrain, grains,
+                   [](uint64_t) { return sort_fn([](int32_t* a, size_t m) { parallelQuickSort(a, 0, m - 1); }); }, inputs, config, &results) &&
+             sweep("parallel_timsort_grain", &sort_tuning::parallelTimSortGrain, grains,
+                   [](uint64_t) { return sort_fn(parallelTimSort); }, inputs, config, &results);
+        if (!ok)
+            return 1;
+    } else {
+        results.push_back({ "parallel_merge_sort_grain", defaults.parallelMergeSortGrain, defaults.parallelMergeSortGrain, 0, 0, "skipped, 1 thread" });
+        results.push_back({ "parallel_quick_sort_grain", defaults.parallelQuickSortGrain, defaults.parallelQuickSortGrain, 0, 0, "skipped, 1 thread" });
+        results.push_back({ "parallel_timsort_grain", defaults.parallelTimSortGrain, defaults.parallelTimSortGrain, 0, 0, "skipped, 1 thread" });
+    }
+
+    if (!tune_radix(config, &results))
+        return 1;
+
+    printf("\n%-28s %10s %10s %12s %12s %8s\n", "parameter", "default", "tuned", "default ms", "tuned ms", "gain");
+    for (const tune_result& r : results) {
+        double const gain = r.defaultSeconds > 0 ? (r.defaultSeconds - r.tunedSeconds) / r.defaultSeconds * 100 : 0;
+        printf("%-28s %10lu %10lu %12.2f %12.2f %7.1f%% %s\n", r.name, r.defaultValue, r.tunedValue, r.defaultSeconds * 1000,
+               r.tunedSeconds * 1000, gain, r.note);
+    }
+
+    if (!sort_tuning_save(sort_tuning_active, config.outPath))
+        return 1;
+    printf("\nWrote %s\n", config.outPath);
+    return 0;
+}
@@ -0,0 +1,731 @@
+// g++ -Wall -Wpedantic -march=haswell -O3 -pthread benchmark.cpp -o benchmark
+// ./benchmark --algo merge_sort,quickSort,timSort --order all --size 500000 --reps 5 --format csv --out runtime_data.csv
+// Get modern behaviour out of time.h, per https://stackoverflow.com/a/40515669
+#define _POSIX_C_SOURCE 199309L
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include "sort_inputs.h"
+#include "merge_sort.h"
+#include "cache_merge_sort.h"
+#include "quick_sort.h"
+#include "intro_sort.h"
+#include "timsort.h"
+#include "radix_sort.h"
+#include "adaptive_sort.h"
+#include "typed_sort.h"
+#include "perf_counters.h"
+#include "page_alloc.h"
+#include "sort_verify.h"
+#include "sort_tuning.h"
+
+// Wrappers giving every sort the same (array, length) signature
+
+void mergeSortAll(DATA_T* arr, size_t n) { merge_sort(arr, 0, n - 1); }
+void parallelMergeSortAll(DATA_T* arr, size_t n) { parallel_merge_sort(arr, 0, n - 1); }
+void cacheMergeSortAll(DATA_T* arr, size_t n) { cache_merge_sort(arr, n); }
+void quickSortAll(DATA_T* arr, size_t n) { quickSort(arr, 0, n - 1); }
+void quickSortBlockAll(DATA_T* arr, size_t n) { quickSortBlock(arr, 0, n - 1); }
+void introSortAll(DATA_T* arr, size_t n) { introSort(arr, 0, n - 1); }
+void parallelQuickSortAll(DATA_T* arr, size_t n) { parallelQuickSort(arr, 0, n - 1); }
+void radixSortAll(DATA_T* arr, size_t n) { radix_sort(arr, n); }
+void adaptiveSortAll(DATA_T* arr, size_t n) { adaptive_sort(arr, n); }
+void stdSortAll(DATA_T* arr, size_t n) { std::sort(arr, arr + n); }
+void inplaceMergeSortAll(DATA_T* arr, size_t n) { typed::inplace_merge_sort(arr, n); }
+
+// The same sorts with the AVX2 merge kernel and sorting network turned off
+void scalarMergeSortAll(DATA_T* arr, size_t n) {
+    simd_merge_enabled = simd_sort_enabled = false;
+    mergeSortAll(arr, n);
+    simd_merge_enabled = simd_sort_enabled = true;
+}
+
+void scalarTimSortAll(DATA_T* arr, size_t n) {
+    simd_merge_enabled = simd_sort_enabled = false;
+    timSort(arr, n);
+    simd_merge_enabled = simd_sort_enabled = true;
+}
+
+// LSD radix sort with a fixed digit width, skipping the range scan
+template <unsigned DigitBits>
+void radixLsdAll(DATA_T* arr, size_t n) {
+    radix_sort_lsd(arr, n, (DATA_T)INT32_MIN, (DATA_T)INT32_MAX, DigitBits);
+}
+
+const char* radixDetail() { return radix_last_report.path; }
+const char* adaptiveDetail() { return adaptive_last_report.choice; }
+
+const char* cacheMergeDetail() {
+    static char detail[64];
+    snprintf(detail, sizeof(detail), "tile %zu fan-in %u passes %u", cache_merge_last_report.tileKeys,
+             cache_merge_last_report.fanIn, cache_merge_last_report.passes);
+    return detail;
+}
+
+struct sort_algorithm {
+    const char* name;
+    void (*sort)(DATA_T*, size_t);
+    const char* (*detail)();   // What the sort decided on its last call, or NULL
+    bool parallel;             // Uses sort_pool, so is timed at every --threads count
+};
+
+static const sort_algorithm algorithms[] = {
+    { "merge_sort", mergeSortAll, NULL, false },
+    { "merge_sort_scalar", scalarMergeSortAll, NULL, false },
+    { "parallel_merge_sort", parallelMergeSortAll, NULL, true },
+    { "cache_merge_sort", cacheMergeSortAll, cacheMergeDetail, false },
+    { "inplace_merge_sort", inplaceMergeSortAll, NULL, false },
+    { "quickSort", quickSortAll, NULL, false },
+    { "quickSortBlock", quickSortBlockAll, NULL, false },
+    { "introSort", introSortAll, NULL, false },
+    { "parallelQuickSort", parallelQuickSortAll, NULL, true },
+    { "timSort", timSort, NULL, false },
+    { "timSort_scalar", scalarTimSortAll, NULL, false },
+    { "parallelTimSort", parallelTimSort, NULL, true },
+    { "radix_sort", radixSortAll, radixDetail, false },
+    { "radix_lsd8", radixLsdAll<8>, NULL, false },
+    { "radix_lsd11", radixLsdAll<11>, NULL, false },
+    { "radix_lsd16", radixLsdAll<16>, NULL, false },
+    { "adaptive_sort", adaptiveSortAll, adaptiveDetail, false },
+    { "std_sort", stdSortAll, NULL, false },
+};
+#define ALGORITHMS (sizeof(algorithms) / sizeof(algorithms[0]))
+
+// Key types the typed_sort.h API is timed on (--type)
+enum key_type { INT32, INT64, FLOAT, DOUBLE, RECORD };
+static const char* const key_type_names[] = { "int32", "int64", "float", "double", "record" };
+#define KEY_TYPES 5
+
+// A 32-byte row sorted by its key, payload and all
+struct record {
+    int64_t key;
+    uint64_t payload[3];
+};
+static inline bool operator<(const record& a, const record& b) { return a.key < b.key; }
+
+// The same payload kept in its own array, for sort_by_key
+struct payload {
+    uint64_t words[3];
+};
+
+// Builds the typed keys from the DATA_T input, keeping its order
+template <typename T>
+T make_key(DATA_T value, size_t) { return (T)value; }
+template <>
+record make_key<record>(DATA_T value, size_t i) { return record{ value, { i, i, i } }; }
+
+// wide_random keys as wide as T: the 64-bit integer keys get all 64 bits
+// from the generator instead of the 32 of DATA_T
+template <typename T>
+T make_wide_key(DATA_T value, size_t i, unsigned) { return make_key<T>(value, i); }
+template <>
+int64_t make_wide_key<int64_t>(DATA_T, size_t i, unsigned seed) { return input_wide64(seed, i); }
+template <>
+record make_wide_key<record>(DATA_T, size_t i, unsigned seed) { return record{ input_wide64(seed, i), { i, i, i } }; }
+
+template <typename T> void typedMergeSortAll(T* arr, size_t n) { typed::merge_sort(arr, n); }
+template <typename T> void typedQuickSortAll(T* arr, size_t n) { typed::quick_sort(arr, n); }
+template <typename T> void typedTimSortAll(T* arr, size_t n) { typed::tim_sort(arr, n); }
+template <typename T> void typedInplaceMergeSortAll(T* arr, size_t n) { typed::inplace_merge_sort(arr, n); }
+template <typename T> void typedStdSortAll(T* arr, size_t n) { std::sort(arr, arr + n); }
+template <typename T> void stdStableSortAll(T* arr, size_t n) { std::stable_sort(arr, arr + n); }
+
+// argsort, then the keys gathered through the permutation
+template <typename T>
+void argsortAll(T* arr, size_t n) {
+    std::vector<size_t> perm(n);
+    std::vector<T> sorted(n);
+    if (!typed::argsort(arr, n, perm.data()))
+        return;
+    for (size_t i = 0; i < n; i++)
+        sorted[i] = arr[perm[i]];
+    std::copy(sorted.begin(), sorted.end(), arr);
+}
+
+// The keys with a payload per key in a separate array (filled inside the
+// timed region, which costs about one extra pass)
+template <typename T>
+void sortByKeyAll(T* arr, size_t n) {
+    std::vector<payload> values(n);
+    for (size_t i = 0; i < n; i++)
+        values[i] = payload{ { i, i, i } };
+    typed::sort_by_key(arr, values.data(), n);
+}
+
+// typed_sort.h instantiated for every key_type
+struct typed_algorithm {
+    const char* name;
+    void (*sortInt32)(int32_t*, size_t);
+    void (*sortInt64)(int64_t*, size_t);
+    void (*sortFloat)(float*, size_t);
+    void (*sortDouble)(double*, size_t);
+    void (*sortRecord)(record*, size_t);
+};
+
+#define TYPED_ALGORITHM(name, fn) { name, fn<int32_t>, fn<int64_t>, fn<float>, fn<double>, fn<record> }
+
+static const typed_algorithm typed_algorithms[] = {
+    TYPED_ALGORITHM("typed_merge_sort", typedMergeSortAll),
+    TYPED_ALGORITHM("typed_quick_sort", typedQuickSortAll),
+    TYPED_ALGORITHM("typed_tim_sort", typedTimSortAll),
+    TYPED_ALGORITHM("typed_inplace_merge_sort", typedInplaceMergeSortAll),
+    TYPED_ALGORITHM("argsort", argsortAll),
+    TYPED_ALGORITHM("sort_by_key", sortByKeyAll),
+    TYPED_ALGORITHM("std_sort", typedStdSortAll),
+    TYPED_ALGORITHM("std_stable_sort", stdStableSortAll),
+};
+#define TYPED_ALGORITHMS (sizeof(typed_algorithms) / sizeof(typed_algorithms[0]))
+
+template <typename T>
+using typed_sort_fn = void (*)(T*, size_t);
+
+// The instantiation of algo for key type T, picked by the array's type
+static inline typed_sort_fn<int32_t> typed_sort_for(const typed_algorithm* algo, int32_t*) { return algo->sortInt32; }
+static inline typed_sort_fn<int64_t> typed_sort_for(const typed_algorithm* algo, int64_t*) { return algo->sortInt64; }
+static inline typed_sort_fn<float> typed_sort_for(const typed_algorithm* algo, float*) { return algo->sortFloat; }
+static inline typed_sort_fn<double> typed_sort_for(const typed_algorithm* algo, double*) { return algo->sortDouble; }
+static inline typed_sort_fn<record> typed_sort_for(const typed_algorithm* algo, record*) { return algo->sortRecord; }
+
+enum output_format { TABLE, CSV, JSON };
+
+// Everything the command line can set
+struct benchmark_config {
+    std::vector<std::string> algoNames;
+    std::vector<const sort_algorithm*> algos;       // int32 only
+    std::vector<const typed_algorithm*> typedAlgos;
+    key_type type = INT32;
+    std::vector<array_ordering> orders;
+    std::vector<uint64_t> sizes;
+    std::vector<unsigned> threads;
+    unsigned reps = 5;
+    unsigned warmup = 1;
+    unsigned seed = 1;
+    output_format format = TABLE;
+    const char* outPath = NULL;
+    bool counters = true;
+    page_policy pages = { PAGES_SMALL, NUMA_DEFAULT };
+    const char* profile = NULL;             // NULL: sort_tuning_default_path
+};
+
+// Summary of the timed repetitions of one configuration
+struct benchmark_result {
+    const char* algo;
+    const char* order;
+    const char* type;
+    uint64_t size;
+    unsigned threads;
+    double wallMin, wallMedian, wallP95;    // Seconds
+    double cpuMin, cpuMedian, cpuP95;
+    double elementsPerSec;                  // At the median wall time
+    uint64_t scratchAllocations;            // Per sort
+    uint64_t scratchPeakBytes;              // Most scratch_arena.h bytes held at once
+    const char* detail;
+    char pages[64];                         // How the sorted array is backed (page_describe)
+    double counters[PERF_COUNTERS];         // Medians per sort, -1 if unavailable
+};
+
+double elapsed_seconds(const struct timespec& start, const struct timespec& end) {
+    return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+// Nearest-rank percentile of sorted samples
+double percentile(const std::vector<double>& sorted, double p) {
+    size_t rank = (size_t)(p * sorted.size() + 0.999999);
+    return sorted[std::min(std::max<size_t>(rank, 1), sorted.size()) - 1];
+}
+
+// Times warmup + reps runs of sort, each on a fresh copy of keys. The
+// hardware counters are only enabled around the sort call itself, so the
+// copy and the sort_verify.h check don't show up in them.
+// Returns the first failed check, or VERIFY_OK if every run sorted its keys.
+template <typename T>
+verify_result run_benchmark(void (*sort)(T*, size_t), const T* keys, T* array, uint64_t length,
+                            const benchmark_config& config, perf_counters* counters, benchmark_result* result) {
+    std::vector<double> wall, cpu, counts[PERF_COUNTERS];
+    verify_digest const input = verify_fingerprint(keys, length);
+    for (unsigned rep = 0; rep < config.warmup + config.reps; rep++) {
+        struct timespec wallStart, wallEnd, cpuStart, cpuEnd;
+        perf_sample sample;
+        std::copy(keys, keys + length, array);
+
+        scratch_allocations = 0;
+        scratch_peak_bytes = 0;
+        perf_counters_start(counters);
+        clock_gettime(CLOCK_MONOTONIC, &wallStart);
+        clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpuStart);
+        sort(array, length);
+        clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpuEnd);
+        clock_gettime(CLOCK_MONOTONIC, &wallEnd);
+        perf_counters_stop(counters, &sample);
+
+        verify_result const verified = verify_sorted(array, length, input);
+        if (verified != VERIFY_OK)
+            return verified;
+        if (rep >= config.warmup) {
+            wall.push_back(elapsed_seconds(wallStart, wallEnd));
+            cpu.push_back(elapsed_seconds(cpuStart, cpuEnd));
+            for (int c = 0; c < PERF_COUNTERS; c++)
+                counts[c].push_back(sample.value[c]);
+        }
+    }
+
+    std::sort(wall.begin(), wall.end());
+    std::sort(cpu.begin(), cpu.end());
+    result->wallMin = wall[0];
+    result->wallMedian = percentile(wall, 0.5);
+    result->wallP95 = percentile(wall, 0.95);
+    result->cpuMin = cpu[0];
+    result->cpuMedian = percentile(cpu, 0.5);
+    result->cpuP95 = percentile(cpu, 0.95);
+    result->elementsPerSec = result->wallMedian > 0 ? length / result->wallMedian : 0;
+    result->scratchAllocations = scratch_allocations.load();
+    result->scratchPeakBytes = scratch_peak_bytes.load();
+    for (int c = 0; c < PERF_COUNTERS; c++) {
+        std::sort(counts[c].begin(), counts[c].end());
+        // A counter that dropped out of any run (sorted first, as -1) is unavailable
+        result->counters[c] = counts[c][0] < 0 ? -1 : percentile(counts[c], 0.5);
+    }
+    return VERIFY_OK;
+}
+
+// Ratio of two counters as shown in the table, or "-" if either is missing
+void print_ratio(FILE* out, double num, double den, double scale, const char* fmt) {
+    if (num < 0 || den <= 0)
+        fprintf(out, " %8s", "-");
+    else
+        fprintf(out, fmt, num / den * scale);
+}
+
+// A byte count as shown in the table, in the largest unit that keeps it >= 1
+void print_bytes(FILE* out, uint64_t bytes) {
+    if (bytes < 1024)
+        fprintf(out, " %9luB", bytes);
+    else if (bytes < (1 << 20))
+        fprintf(out, " %8.1fKi", bytes / 1024.0);
+    else if (bytes < (1 << 30))
+        fprintf(out, " %8.1fMi", bytes / (double)(1 << 20));
+    else
+        fprintf(out, " %8.1fGi", bytes / (double)(1 << 30));
+}
+
+void print_header(FILE* out, output_format format) {
+    if (format == TABLE) {
+        fprintf(out, "%-24s %-17s %-6s %10s %3s %10s %10s %10s %10s %12s %10s %8s %8s %8s %8s %8s %-28s %s\n", "algorithm", "ordering", "type", "size",
+                "thr", "wall min", "wall med", "wall p95", "cpu med", "Melem/s", "scratch", "IPC", "br-miss%", "L1-miss%", "LLC-miss%",
+                "dTLB-miss%", "pages", "detail");
+    } else if (format == CSV) {
+        fprintf(out, "algorithm,ordering,type,size,threads,wall_min_ms,wall_median_ms,wall_p95_ms,"
+                     "cpu_min_ms,cpu_median_ms,cpu_p95_ms,elements_per_sec,scratch_allocations,scratch_peak_bytes,pages,detail");
+        for (int c = 0; c < PERF_COUNTERS; c++)
+            fprintf(out, ",%s", perf_counter_names[c]);
+        fprintf(out, "\n");
+    } else {
+        fprintf(out, "[");
+    }
+}
+
+void print_result(FILE* out, output_format format, const benchmark_result& r, bool first) {
+    if (format == TABLE) {
+        fprintf(out, "%-24s %-17s %-6s %10lu %3u %7.2f ms %7.2f ms %7.2f ms %7.2f ms %12.2f", r.algo, r.order, r.type, r.size, r.threads,
+                r.wallMin * 1000, r.wallMedian * 1000, r.wallP95 * 1000, r.cpuMedian * 1000, r.elementsPerSec / 1e6);
+        print_bytes(out, r.scratchPeakBytes);
+        print_ratio(out, r.counters[PERF_INSTRUCTIONS], r.counters[PERF_CYCLES], 1, " %8.2f");
+        print_ratio(out, r.counters[PERF_BRANCH_MISSES], r.counters[PERF_BRANCHES], 100, " %7.2f%%");
+        print_ratio(out, r.counters[PERF_L1D_MISSES], r.counters[PERF_L1D_LOADS], 100, " %7.2f%%");
+        print_ratio(out, r.counters[PERF_LLC_MISSES], r.counters[PERF_LLC_LOADS], 100, " %7.2f%%");
+        print_ratio(out, r.counters[PERF_DTLB_MISSES], r.counters[PERF_DTLB_LOADS], 100, " %7.2f%%");
+        fprintf(out, " %-28s %s\n", r.pages, r.detail);
+    } else if (format == CSV) {
+        fprintf(out, "%s,%s,%s,%lu,%u,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.0f,%lu,%lu,%s,%s", r.algo, r.order, r.type, r.size, r.threads,
+                r.wallMin * 1000, r.wallMedian * 1000, r.wallP95 * 1000, r.cpuMin * 1000, r.cpuMedian * 1000, r.cpuP95 * 1000,
+                r.elementsPerSec, r.scratchAllocations, r.scratchPeakBytes, r.pages, r.detail);
+        // Unavailable counters are left empty
+        for (int c = 0; c < PERF_COUNTERS; c++) {
+            if (r.counters[c] < 0)
+                fprintf(out, ",");
+            else
+                fprintf(out, ",%.0f", r.counters[c]);
+        }
+        fprintf(out, "\n");
+    } else {
+        fprintf(out, "%s\n  {\"algorithm\": \"%s\", \"ordering\": \"%s\", \"type\": \"%s\", \"size\": %lu, \"threads\": %u, "
+                     "\"wall_min_ms\": %.4f, \"wall_median_ms\": %.4f, \"wall_p95_ms\": %.4f, "
+                     "\"cpu_min_ms\": %.4f, \"cpu_median_ms\": %.4f, \"cpu_p95_ms\": %.4f, "
+                     "\"elements_per_sec\": %.0f, \"scratch_allocations\": %lu, \"scratch_peak_bytes\": %lu, \"pages\": \"%s\", \"detail\": \"%s\", "
+                     "\"counters\": {",
+                first ? "" : ",", r.algo, r.order, r.type, r.size, r.threads, r.wallMin * 1000, r.wallMedian * 1000, r.wallP95 * 1000,
+                r.cpuMin * 1000, r.cpuMedian * 1000, r.cpuP95 * 1000, r.elementsPerSec, r.scratchAllocations, r.scratchPeakBytes, r.pages,
+                r.detail);
+        // Unavailable counters are null
+        for (int c = 0; c < PERF_COUNTERS; c++) {
+            if (r.counters[c] < 0)
+                fprintf(out, "%s\"%s\": null", c ? ", " : "", perf_counter_names[c]);
+            else
+                fprintf(out, "%s\"%s\": %.0f", c ? ", " : "", perf_counter_names[c], r.counters[c]);
+        }
+        fprintf(out, "}}");
+    }
+}
+
+void print_footer(FILE* out, output_format format) {
+    if (format == JSON)
+        fprintf(out, "\n]\n");
+}
+
+// page_describe of p[0..bytes) after its sorts
+void describe_pages(const void* p, size_t bytes, char* out, size_t size) {
+    page_report report;
+    page_report_of(p, bytes, &report);
+    page_describe(&report, out, size);
+}
+
+// Times config.typedAlgos on source converted to T, printing a result for
+// each. The array they sort comes from page_alloc like the int32 one.
+// Returns false if one of them fails sort_verify.h's check.
+template <typename T>
+bool run_typed(const DATA_T* source, uint64_t length, array_ordering order, unsigned threads,
+               const benchmark_config& config, perf_counters* counters, FILE* out, bool* first) {
+    static_assert(std::is_trivially_copyable<T>::value, "the array is raw page_alloc memory");
+    std::vector<T> keys(length);
+    T* array = (T*)page_alloc_populated(length * sizeof(T));
+    if (array == NULL) {
+        printf("Couldn't allocate.\n");
+        return false;
+    }
+    for (size_t i = 0; i < length; i++)
+        keys[i] = order == WIDE_RANDOM ? make_wide_key<T>(source[i], i, config.seed) : make_key<T>(source[i], i);
+
+    for (const typed_algorithm* algo : config.typedAlgos) {
+        benchmark_result result;
+        result.algo = algo->name;
+        result.order = array_ordering_names[order];
+        result.type = key_type_names[config.type];
+        result.size = length;
+        result.threads = threads;
+        result.detail = "";
+        verify_result const verified = run_benchmark(typed_sort_for(algo, array), keys.data(), array, length, config, counters, &result);
+        if (verified != VERIFY_OK) {
+            fprintf(stderr, "%s left %s %s input of %lu values %s\n", algo->name, result.order, result.type, length, verify_result_names[verified]);
+            page_free(array, length * sizeof(T));
+            return false;
+        }
+        describe_pages(array, length * sizeof(T), result.pages, sizeof(result.pages));
+        print_result(out, config.format, result, *first);
+        fflush(out);
+        *first = false;
+    }
+    page_free(array, length * sizeof(T));
+    return true;
+}
+
+void usage() {
+    printf("Usage: benchmark [options]\n"
+           "  --algo a,b,...     algorithms to time, or all (default merge_sort,quickSort,timSort)\n"
+           "  --order a,b,...    orderings to sort, or all (default all)\n"
+           "  --type t           key type: int32, int64, float, double or record (a 32-byte\n"
+           "                     row); other than int32 only the typed algorithms run\n"
+           "                     (default int32)\n"
+           "  --size n,m,...     array lengths (default 100000)\n"
+           "  --threads n,m,...  pool sizes for the parallel sorts (default all hardware threads);\n"
+           "                     sequential sorts only run at the first one\n"
+           "  --reps n           timed repetitions (default 5)\n"
+           "  --warmup n         untimed repetitions first (default 1)\n"
+           "  --seed n           seed for the input arrays (default 1)\n"
+           "  --format f         table, csv or json (default table)\n"
+           "  --out file         write results to file instead of stdout\n"
+           "  --counters on|off  read hardware counters around each sort (default on)\n"
+           "  --pages p          pages for the sorted array and large scratch buffers:\n"
+           "                     small, thp or hugetlb (default small)\n"
+           "  --numa n           their NUMA placement: default, first_touch (by the pool's\n"
+           "                     threads) or interleave (default default)\n"
+           "  --profile file     thresholds written by autotune (default $SORT_TUNING_PROFILE\n"
+           "                     or sort_tuning.<hostname>.profile, if there is one)\n"
+           "Algorithms:");
+    for (size_t a = 0; a < ALGORITHMS; a++)
+        printf(" %s", algorithms[a].name);
+    printf("\nTyped algorithms:");
+    for (size_t a = 0; a < TYPED_ALGORITHMS; a++)
+        printf(" %s", typed_algorithms[a].name);
+    printf("\nOrderings:");
+    for (int o = 0; o < ARRAY_ORDERINGS; o++)
+        printf(" %s", array_ordering_names[o]);
+    printf("\n");
+}
+
+// Splits a comma-separated list
+std::vector<std::string> split_list(const char* list) {
+    std::vector<std::string> items;
+    std::string item;
+    for (const char* c = list;; c++) {
+        if (*c == ',' || *c == '\0') {
+            if (!item.empty())
+                items.push_back(item);
+            item.clear();
+            if (*c == '\0')
+                return items;
+        } else {
+            item += *c;
+        }
+    }
+}
+
+// Fills config from argv; prints what's wrong and returns false on bad input
+bool parse_args(int argc, char* argv[], benchmark_config* config) {
+    for (int i = 1; i < argc; i++) {
+        const char* opt = argv[i];
+        if (strcmp(opt, "--help") == 0) {
+            usage();
+            exit(0);
+        }
+        if (i + 1 >= argc) {
+            fprintf(stderr, "Missing value for %s\n", opt);
+            return false;
+        }
+        const char* value = argv[++i];
+
+        if (strcmp(opt, "--algo") == 0) {
+            // Looked up once --type is known
+            for (const std::string& name : split_list(value))
+                config->algoNames.push_back(name);
+        } else if (strcmp(opt, "--type") == 0) {
+            int t = 0;
+            while (t < KEY_TYPES && strcmp(value, key_type_names[t]) != 0)
+                t++;
+            if (t == KEY_TYPES) {
+                fprintf(stderr, "Unknown key type %s\n", value);
+                return false;
+            }
+            config->type = (key_type)t;
+        } else if (strcmp(opt, "--order") == 0) {
+            for (const std::string& name : split_list(value)) {
+                size_t found = 0;
+                for (int o = 0; o < ARRAY_ORDERINGS; o++) {
+                    if (name == "all" || name == array_ordering_names[o]) {
+                        config->orders.push_back((array_ordering)o);
+                        found++;
+                    }
+                }
+                if (!found) {
+                    fprintf(stderr, "Unknown ordering %s\n", name.c_str());
+                    return false;
+                }
+            }
+        } else if (strcmp(opt, "--size") == 0) {
+            for (const std::string& size : split_list(value))
+                config->sizes.push_back(strtoull(size.c_str(), NULL, 10));
+        } else if (strcmp(opt, "--threads") == 0) {
+            for (const std::string& threads : split_list(value))
+                config->threads.push_back(atoi(threads.c_str()));
+        } else if (strcmp(opt, "--reps") == 0) {
+            config->reps = atoi(value);
+        } else if (strcmp(opt, "--warmup") == 0) {
+            config->warmup = atoi(value);
+        } else if (strcmp(opt, "--seed") == 0) {
+            config->seed = atoi(value);
+        } else if (strcmp(opt, "--format") == 0) {
+            if (strcmp(value, "table") == 0)
+                config->format = TABLE;
+            else if (strcmp(value, "csv") == 0)
+                config->format = CSV;
+            else if (strcmp(value, "json") == 0)
+                config->format = JSON;
+            else {
+                fprintf(stderr, "Unknown format %s\n", value);
+                return false;
+            }
+        } else if (strcmp(opt, "--out") == 0) {
+            config->outPath = value;
+        } else if (strcmp(opt, "--counters") == 0) {
+            config->counters = strcmp(value, "off") != 0;
+        } else if (strcmp(opt, "--pages") == 0) {
+            int p = 0;
+            while (p < PAGE_SIZE_POLICIES && strcmp(value, page_size_names[p]) != 0)
+                p++;
+            if (p == PAGE_SIZE_POLICIES) {
+                fprintf(stderr, "Unknown page size %s\n", value);
+                return false;
+            }
+            config->pages.size = (page_size_policy)p;
+        } else if (strcmp(opt, "--profile") == 0) {
+            config->profile = value;
+        } else if (strcmp(opt, "--numa") == 0) {
+            int n = 0;
+            while (n < PAGE_NUMA_POLICIES && strcmp(value, page_numa_names[n]) != 0)
+                n++;
+            if (n == PAGE_NUMA_POLICIES) {
+                fprintf(stderr, "Unknown NUMA placement %s\n", value);
+                return false;
+            }
+            config->pages.numa = (page_numa_policy)n;
+        } else {
+            fprintf(stderr, "Unknown option %s\n", opt);
+            return false;
+        }
+    }
+
+    if (config->algoNames.empty()) {
+        if (config->type == INT32)
+            config->algoNames = { "merge_sort", "quickSort", "timSort" };
+        else
+            config->algoNames = { "typed_merge_sort", "typed_quick_sort", "typed_tim_sort" };
+    }
+    // int32 keys can use every sort; a name in both lists (std_sort) means
+    // the int32 one. Other key types only have the typed algorithms.
+    for (const std::string& name : config->algoNames) {
+        size_t found = 0;
+        for (size_t a = 0; a < ALGORITHMS && config->type == INT32; a++) {
+            if (name == "all" || name == algorithms[a].name) {
+                config->algos.push_back(&algorithms[a]);
+                found++;
+            }
+        }
+        for (size_t a = 0; a < TYPED_ALGORITHMS; a++) {
+            bool shadowed = false;
+            for (size_t b = 0; b < ALGORITHMS && config->type == INT32; b++)
+                shadowed |= strcmp(algorithms[b].name, typed_algorithms[a].name) == 0;
+            if ((name == "all" && !shadowed) || (name == typed_algorithms[a].name && !found)) {
+                config->typedAlgos.push_back(&typed_algorithms[a]);
+                found++;
+            }
+        }
+        if (!found) {
+            fprintf(stderr, "Unknown algorithm %s for --type %s\n", name.c_str(), key_type_names[config->type]);
+            return false;
+        }
+    }
+    if (config->orders.empty())
+        for (int o = 0; o < ARRAY_ORDERINGS; o++)
+            config->orders.push_back((array_ordering)o);
+    if (config->sizes.empty())
+        config->sizes.push_back(100000);
+    if (config->threads.empty())
+        config->threads.push_back(std::thread::hardware_concurrency());
+
+    if (config->reps == 0) {
+        fprintf(stderr, "--reps must be at least 1\n");
+        return false;
+    }
+    for (uint64_t size : config->sizes) {
+        if (size < 2) {
+            fprintf(stderr, "--size must be at least 2\n");
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    benchmark_config config;
+    if (!parse_args(argc, argv, &config)) {
+        usage();
+        return 1;
+    }
+
+    FILE* out = stdout;
+    if (config.outPath != NULL) {
+        out = fopen(config.outPath, "w");
+        if (out == NULL) {
+            perror(config.outPath);
+            return 1;
+        }
+    }
+
+    // Opened before the pool is (re)created so its workers inherit them
+    perf_counters counters;
+    int available = 0;
+    if (config.counters) {
+        available = perf_counters_open(&counters);
+    } else {
+        for (int c = 0; c < PERF_COUNTERS; c++)
+            counters.fd[c] = -1;
+    }
+    if (config.counters && available < PERF_COUNTERS) {
+        fprintf(stderr, "Only %d of %d hardware counters available (see /proc/sys/kernel/perf_event_paranoid); missing:",
+                available, PERF_COUNTERS);
+        for (int c = 0; c < PERF_COUNTERS; c++)
+            if (counters.fd[c] < 0)
+                fprintf(stderr, " %s", perf_counter_names[c]);
+        fprintf(stderr, "\n");
+    }
+
+    // Before anything large is allocated, so page_free matches page_alloc
+    page_alloc_policy = config.pages;
+    // Before the first sort picks its instantiations
+    if (!sort_tuning_load(config.profile)) {
+        fprintf(stderr, "Couldn't read %s\n", config.profile);
+        return 1;
+    }
+
+    print_header(out, config.format);
+    bool first = true;
+    for (unsigned threads : config.threads) {
+        sort_pool_init(threads);
+        for (uint64_t length : config.sizes) {
+            DATA_T* array = (DATA_T*)page_alloc_populated(length * sizeof(DATA_T));
+            if (array == NULL) {
+                printf("Couldn't allocate.\n");
+                return 1;
+            }
+            if (page_hugetlb_fallbacks.exchange(0) > 0)
+                fprintf(stderr, "No free hugetlb pages for %lu values (see /proc/sys/vm/nr_hugepages); using thp\n", length);
+            for (array_ordering order : config.orders) {
+                // Every algorithm and repetition sorts a copy of the same keys
+                DATA_T* keys = create_array(length, order, config.seed);
+                if (keys == NULL) {
+                    printf("Couldn't allocate.\n");
+                    return 1;
+                }
+                for (const sort_algorithm* algo : config.algos) {
+                    // Sequential sorts don't care about the pool size
+                    if (!algo->parallel && threads != config.threads[0])
+                        continue;
+                    benchmark_result result;
+                    result.algo = algo->name;
+                    result.order = array_ordering_names[order];
+                    result.type = key_type_names[INT32];
+                    result.size = length;
+                    result.threads = threads;
+                    verify_result const verified = run_benchmark(algo->sort, keys, array, length, config, &counters, &result);
+                    if (verified != VERIFY_OK) {
+                        fprintf(stderr, "%s left %s input of %lu values %s\n", algo->name, result.order, length, verify_result_names[verified]);
+                        return 1;
+                    }
+                    result.detail = algo->detail ? algo->detail() : "";
+                    describe_pages(array, length * sizeof(DATA_T), result.pages, sizeof(result.pages));
+                    print_result(out, config.format, result, first);
+                    fflush(out);
+                    first = false;
+                }
+
+                // The typed sorts are all sequential
+                bool sorted = true;
+                if (!config.typedAlgos.empty() && threads == config.threads[0]) {
+                    switch (config.type) {
+                    case INT32: sorted = run_typed<int32_t>(keys, length, order, threads, config, &counters, out, &first); break;
+                    case INT64: sorted = run_typed<int64_t>(keys, length, order, threads, config, &counters, out, &first); break;
+                    case FLOAT: sorted = run_typed<float>(keys, length, order, threads, config, &counters, out, &first); break;
+                    case DOUBLE: sorted = run_typed<double>(keys, length, order, threads, config, &counters, out, &first); break;
+                    case RECORD: sorted = run_typed<record>(keys, length, order, threads, config, &counters, out, &first); break;
+                    }
+                }
+                if (!sorted)
+                    return 1;
+                free(keys);
+            }
+            page_free(array, length * sizeof(DATA_T));
+        }
+    }
+    print_footer(out, config.format);
+    perf_counters_close(&counters);
+
+    if (out != stdout)
+        fclose(out);
+    return 0;
+}
@@ -0,0 +1,242 @@
+// Cache-aware merge sort on 32-bit keys. merge_sort recurses all the way
+// down and then merges two runs per level, so an array larger than the
+// last-level cache streams through memory log2(n / 64) times. Here instead:
+//   1. tiles small enough to be sorted with their scratch inside L2 are
+//      sorted one at a time with merge_sort_into, whose recursion keeps the
+//      lower levels in L1
+//   2. the sorted tiles are merged up to fan-in at a time by a loser tree,
+//      so each pass over memory covers log2(fan-in) levels of the merge tree
+// Each input stream is prefetched a few lines ahead, since dozens of
+// streams are more than the hardware prefetcher will track.
+// Cache sizes are read from sysfs the first time they're needed.
+#ifndef CACHE_MERGE_SORT_H
+#define CACHE_MERGE_SORT_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include "intro_sort.h"
+#include "scratch_arena.h"
+#include "merge_sort.h"
+
+// Used when sysfs has no cache information: the machine in
+// Data/cache_runtime_data.txt, per core
+#define CACHE_DEFAULT_L1D (32 << 10)
+#define CACHE_DEFAULT_L2 (256 << 10)
+#define CACHE_DEFAULT_L3 (9 << 20)
+// Most runs a loser tree merges at once
+#define CACHE_MERGE_MAX_FAN_IN 64
+// How far ahead of each merge stream to prefetch
+#define CACHE_MERGE_PREFETCH_LINES 8
+
+struct cache_sizes {
+    size_t l1d, l2, l3;     // Bytes
+};
+
+// Reads a cache size such as "48K" or "30M" from sysfs; 0 if missing
+static inline size_t read_cache_size(const char* path) {
+    FILE* f = fopen(path, "r");
+    if (f == NULL)
+        return 0;
+    unsigned long size = 0;
+    char unit = 0;
+    int fields = fscanf(f, "%lu%c", &size, &unit);
+    fclose(f);
+    if (fields < 1)
+        return 0;
+    if (unit == 'K')
+        size <<= 10;
+    else if (unit == 'M')
+        size <<= 20;
+    return size;
+}
+
+// CPU 0's data and unified caches, from /sys/devices/system/cpu/cpu0/cache,
+// falling back to the CACHE_DEFAULT_ sizes for any level not found
+static inline cache_sizes detect_cache_sizes() {
+    static cache_sizes sizes = [] {
+        cache_sizes found = { 0, 0, 0 };
+        for (int index = 0; index < 8; index++) {
+            char path[96], type[16] = "";
+            unsigned level = 0;
+            snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu0/cache/index%d/level", index);
+            FILE* f = fopen(path, "r");
+            if (f == NULL)
+                break;
+            int fields = fscanf(f, "%u", &level);
+            fclose(f);
+            snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu0/cache/index%d/type", index);
+            f = fopen(path, "r");
+            if (f != NULL) {
+                fields += fscanf(f, "%15s", type);
+                fclose(f);
+            }
+            if (fields < 2 || strcmp(type, "Instruction") == 0)
+                continue;
+            snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu0/cache/index%d/size", index);
+            size_t size = read_cache_size(path);
+            if (level == 1)
+                found.l1d = size;
+            else if (level == 2)
+                found.l2 = size;
+            else if (level == 3)
+                found.l3 = size;
+        }
+        if (found.l1d == 0)
+            found.l1d = CACHE_DEFAULT_L1D;
+        if (found.l2 == 0)
+            found.l2 = CACHE_DEFAULT_L2;
+        if (found.l3 == 0)
+            found.l3 = CACHE_DEFAULT_L3;
+        return found;
+    }();
+    return sizes;
+}
+
+// What the last cache_merge_sort call did, for the benchmark output
+struct cache_merge_report {
+    size_t tileKeys;
+    unsigned fanIn;
+    unsigned passes;        // Merge passes over the whole array
+};
+static cache_merge_report cache_merge_last_report;
+
+// Loser tree over up to leaves (a power of two) sorted streams. Keys are
+// packed with their stream number as (key, stream) in one uint64_t, so one
+// unsigned compare orders them and breaks ties towards the lower stream,
+// which keeps the merge stable. An exhausted stream is UINT64_MAX.
+// Each stream's entry after the one in the tree is kept ready in next, so
+// replaying a stream doesn't wait on loading its pointer and then its key.
+struct loser_tree {
+    unsigned leaves;
+    uint64_t node[CACHE_MERGE_MAX_FAN_IN];      // node[0] is the winner
+    uint64_t next[CACHE_MERGE_MAX_FAN_IN];
+    const int32_t* cur[CACHE_MERGE_MAX_FAN_IN]; // Key behind next
+    const int32_t* end[CACHE_MERGE_MAX_FAN_IN];
+};
+
+static inline uint64_t loser_tree_entry(int32_t key, unsigned stream) {
+    return ((uint64_t)((uint32_t)key ^ 0x80000000u) << 32) | stream;
+}
+
+static inline void loser_tree_init(loser_tree* lt, unsigned leaves) {
+    uint64_t winner[2 * CACHE_MERGE_MAX_FAN_IN];
+    lt->leaves = leaves;
+    for (unsigned s = 0; s < leaves; s++) {
+        const int32_t* p = lt->cur[s];
+        winner[leaves + s] = p < lt->end[s] ? loser_tree_entry(p[0], s) : UINT64_MAX;
+        lt->cur[s] = p = std::min(p + 1, lt->end[s]);
+        lt->next[s] = p < lt->end[s] ? loser_tree_entry(p[0], s) : UINT64_MAX;
+    }
+    for (unsigned i = leaves - 1; i >= 1; i--) {
+        uint64_t left = winner[2 * i], right = winner[2 * i + 1];
+        winner[i] = std::min(left, right);
+        lt->node[i] = std::max(left, right);
+    }
+    lt->node[0] = winner[1];
+}
+
+// Merges the streams set up in lt into out until all are exhausted
+static inline void loser_tree_merge(loser_tree* lt, int32_t* out) {
+    unsigned const leaves = lt->leaves;
+    uint64_t winner = lt->node[0];
+    while (winner != UINT64_MAX) {
+        unsigned s = (uint32_t)winner;
+        *out++ = (int32_t)((uint32_t)(winner >> 32) ^ 0x80000000u);
+
+        uint64_t v = lt->next[s];
+        const int32_t* p = ++lt->cur[s];
+        // Once per cache line, fetch the line a few ahead in this stream
+        if (((uintptr_t)p & 63) == 0)
+            __builtin_prefetch(p + CACHE_MERGE_PREFETCH_LINES * 16);
+        lt->next[s] = p < lt->end[s] ? loser_tree_entry(*p, s) : UINT64_MAX;
+
+        // Replay the path to the root: the smaller value moves up, the
+        // larger stays as that node's loser
+        for (unsigned i = (leaves + s) >> 1; i >= 1; i >>= 1) {
+            uint64_t loser = lt->node[i];
+            bool const swap = loser < v;
+            lt->node[i] = swap ? v : loser;
+            v = swap ? loser : v;
+        }
+        winner = v;
+    }
+}
+
+// Sorts a[0..n) tile by tile, then with loser-tree merge passes
+static inline void cache_merge_sort(int32_t* a, size_t n) {
+    cache_sizes const caches = detect_cache_sizes();
+    // A tile and its scratch take half of L2, leaving room for everything else
+    size_t const tileKeys = std::max<size_t>(caches.l2 / 4 / sizeof(int32_t), MERGE_SORT_BASE_CASE);
+    cache_merge_last_report = cache_merge_report{ tileKeys, 1, 0 };
+    if (n < 2)
+        return;
+    if (n <= tileKeys) {
+        merge_sort(a, 0, n - 1);
+        return;
+    }
+
+    scratch_arena<int32_t> arena;
+    if (!arena_init(&arena, n)) {
+        introSort(a, 0, n - 1);
+        return;
+    }
+
+    // Phase 1: each tile is copied to scratch while it's being read anyway,
+    // then sorted back into place without leaving L2
+    for (size_t lo = 0; lo < n; lo += tileKeys) {
+        size_t len = std::min(tileKeys, n - lo);
+        std::copy(a + lo, a + lo + len, arena.buffer + lo);
+        merge_sort_into(arena.buffer + lo, a + lo, 0, len - 1);
+    }
+
+    // Phase 2: as few passes as the fan-in limit allows, with the fan-in
+    // then evened out so the last pass isn't a lopsided one. The streams'
+    // lines and prefetches should fit in L1 alongside the tree.
+    size_t const runs = (n + tileKeys - 1) / tileKeys;
+    size_t maxFanIn = 4;
+    while (maxFanIn < CACHE_MERGE_MAX_FAN_IN && maxFanIn * 2 * 64 * CACHE_MERGE_PREFETCH_LINES <= caches.l1d)
+        maxFanIn *= 2;
+    unsigned passes = 0;
+    for (size_t reach = 1; reach < runs; reach *= maxFanIn)
+        passes++;
+    unsigned fanIn = 2;
+    while (true) {
+        size_t reach = 1;
+        for (unsigned p = 0; p < passes; p++)
+            reach *= fanIn;
+        if (reach >= runs)
+            break;
+        fanIn++;
+    }
+    unsigned leaves = 2;
+    while (leaves < fanIn)
+        leaves *= 2;
+    cache_merge_last_report.fanIn = fanIn;
+    cache_merge_last_report.passes = passes;
+
+    int32_t* src = a;
+    int32_t* dst = arena.buffer;
+    loser_tree lt;
+    for (size_t runLen = tileKeys; runLen < n; runLen *= fanIn) {
+        for (size_t lo = 0; lo < n; lo += runLen * fanIn) {
+            for (unsigned s = 0; s < leaves; s++) {
+                size_t begin = std::min(n, lo + s * runLen);
+                size_t end = s < fanIn ? std::min(n, begin + runLen) : begin;
+                lt.cur[s] = src + begin;
+                lt.end[s] = src + end;
+            }
+            loser_tree_init(&lt, leaves);
+            loser_tree_merge(&lt, dst + lo);
+        }
+        std::swap(src, dst);
+    }
+
+    if (src != a)
+        std::copy(src, src + n, a);
+    arena_free(&arena);
+}
+
+#endif
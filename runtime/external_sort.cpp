@@ -0,0 +1,209 @@
+// g++ -Wall -Wpedantic -march=haswell -O3 -pthread external_sort.cpp -o external_sort
+// ./external_sort --generate 100000000 --order wide_random --out keys.bin
+// ./external_sort --in keys.bin --out sorted.bin --memory 256M --block 1M --fan-in 64 --verify
+// Sorts a file of raw native-endian 32-bit keys that may be larger than
+// memory (see external_sort.h), and reports the bytes moved and passes made
+// so chunk and block sizes can be tuned against the disk.
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "sort_inputs.h"
+#include "external_sort.h"
+#include "sort_verify.h"
+
+// Parses a byte count with an optional K, M or G suffix
+bool parse_bytes(const char* value, size_t* bytes) {
+    char* end;
+    unsigned long long n = strtoull(value, &end, 10);
+    switch (*end) {
+    case 'G': case 'g': n <<= 10; // Fall through
+    case 'M': case 'm': n <<= 10; // Fall through
+    case 'K': case 'k': n <<= 10; end++; break;
+    }
+    *bytes = n;
+    return *end == '\0' && n > 0;
+}
+
+// Writes count keys in the given ordering, a chunk at a time. Orderings
+// other than random ones are built per chunk, so e.g. sorted input is a
+// sequence of sorted chunks.
+bool generate(const char* path, uint64_t count, array_ordering order, unsigned seed) {
+    FILE* out = fopen(path, "wb");
+    if (out == NULL) {
+        perror(path);
+        return false;
+    }
+    size_t const chunk = 1 << 24;
+    for (uint64_t first = 0; first < count; first += chunk) {
+        size_t keys = (size_t)std::min<uint64_t>(chunk, count - first);
+        DATA_T* array = create_array(keys, order, seed + (unsigned)(first / chunk));
+        if (array == NULL || fwrite(array, sizeof(DATA_T), keys, out) != keys) {
+            perror(path);
+            free(array);
+            fclose(out);
+            return false;
+        }
+        free(array);
+    }
+    return fclose(out) == 0;
+}
+
+// Streams path into a digest (see sort_verify.h); with order set, also
+// checks its keys never decrease
+bool digest_file(const char* path, bool order, verify_digest* digest) {
+    FILE* in = fopen(path, "rb");
+    if (in == NULL) {
+        perror(path);
+        return false;
+    }
+    std::vector<int32_t> buffer(1 << 20);
+    *digest = verify_digest{ 0, 0, 0 };
+    bool sorted = true;
+    int32_t previous = INT32_MIN;
+    size_t n;
+    while ((n = fread(buffer.data(), sizeof(int32_t), buffer.size(), in)) > 0) {
+        if (order && buffer[0] < previous)
+            sorted = false;
+        verify_scan(buffer.data(), n, order, &sorted, digest);
+        previous = buffer[n - 1];
+    }
+    fclose(in);
+    if (!sorted) {
+        fprintf(stderr, "%s: keys are out of order\n", path);
+        return false;
+    }
+    return true;
+}
+
+// Checks outPath is sorted and has the digest external_sort took of the
+// input as it read it
+bool verify(const char* outPath, const verify_digest& input) {
+    verify_digest output;
+    if (!digest_file(outPath, true, &output))
+        return false;
+    if (output.count != input.count) {
+        fprintf(stderr, "%s: has %lu keys, expected %lu\n", outPath, output.count, input.count);
+        return false;
+    }
+    if (!(output == input)) {
+        fprintf(stderr, "%s: keys lost or duplicated\n", outPath);
+        return false;
+    }
+    return true;
+}
+
+void usage() {
+    printf("Usage: external_sort --in file --out file [options]\n"
+           "       external_sort --generate count --out file [--order o] [--seed n]\n"
+           "  --memory bytes     all the memory for chunks, sort scratch and merge buffers\n"
+           "                     (default 256M)\n"
+           "  --block bytes      read/write size while merging (default 1M)\n"
+           "  --fan-in n         most runs merged at once (default %d)\n"
+           "  --tmp dir          where runs are spilled (default /tmp)\n"
+           "  --verify           check the output is sorted and holds the input's keys\n"
+           "Sizes take a K, M or G suffix. Files are raw native-endian 32-bit keys.\n"
+           "Orderings:",
+           EXTERNAL_DEFAULT_FAN_IN);
+    for (int o = 0; o < ARRAY_ORDERINGS; o++)
+        printf(" %s", array_ordering_names[o]);
+    printf("\n");
+}
+
+int main(int argc, char* argv[]) {
+    external_sort_config config;
+    const char* inPath = NULL;
+    const char* outPath = NULL;
+    uint64_t generateCount = 0;
+    array_ordering order = WIDE_RANDOM;
+    unsigned seed = 1;
+    bool check = false;
+
+    for (int i = 1; i < argc; i++) {
+        const char* opt = argv[i];
+        if (strcmp(opt, "--help") == 0) {
+            usage();
+            return 0;
+        }
+        if (strcmp(opt, "--verify") == 0) {
+            check = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            fprintf(stderr, "Missing value for %s\n", opt);
+            usage();
+            return 1;
+        }
+        const char* value = argv[++i];
+        bool good = true;
+        if (strcmp(opt, "--in") == 0) {
+            inPath = value;
+        } else if (strcmp(opt, "--out") == 0) {
+            outPath = value;
+        } else if (strcmp(opt, "--memory") == 0) {
+            good = parse_bytes(value, &config.memoryBytes);
+        } else if (strcmp(opt, "--block") == 0) {
+            good = parse_bytes(value, &config.blockBytes);
+        } else if (strcmp(opt, "--fan-in") == 0) {
+            config.maxFanIn = atoi(value);
+            good = config.maxFanIn >= 2;
+        } else if (strcmp(opt, "--tmp") == 0) {
+            config.tmpDir = value;
+        } else if (strcmp(opt, "--generate") == 0) {
+            generateCount = strtoull(value, NULL, 10);
+            good = generateCount > 0;
+        } else if (strcmp(opt, "--order") == 0) {
+            int o = 0;
+            while (o < ARRAY_ORDERINGS && strcmp(value, array_ordering_names[o]) != 0)
+                o++;
+            good = o < ARRAY_ORDERINGS;
+            order = (array_ordering)o;
+        } else if (strcmp(opt, "--seed") == 0) {
+            seed = atoi(value);
+        } else {
+            fprintf(stderr, "Unknown option %s\n", opt);
+            usage();
+            return 1;
+        }
+        if (!good) {
+            fprintf(stderr, "Bad value for %s: %s\n", opt, value);
+            return 1;
+        }
+    }
+
+    if (outPath == NULL || (inPath == NULL && generateCount == 0)) {
+        usage();
+        return 1;
+    }
+    if (generateCount > 0)
+        return generate(outPath, generateCount, order, seed) ? 0 : 1;
+
+    verify_digest input;
+    if (check)
+        config.inputDigest = &input;
+    external_sort_report report;
+    if (!external_sort(inPath, outPath, config, &report))
+        return 1;
+
+    double const inputBytes = report.keys * sizeof(int32_t);
+    double const seconds = report.runSeconds + report.mergeSeconds;
+    printf("keys           %lu (%.1f MiB)\n", report.keys, inputBytes / (1 << 20));
+    printf("runs           %u of up to %lu keys\n", report.runs, report.chunkKeys);
+    printf("fan-in         %u\n", report.fanIn);
+    printf("passes         %u\n", report.passes);
+    printf("bytes read     %lu (%.2fx input)\n", report.bytesRead, inputBytes ? report.bytesRead / inputBytes : 0);
+    printf("bytes written  %lu (%.2fx input)\n", report.bytesWritten, inputBytes ? report.bytesWritten / inputBytes : 0);
+    printf("run phase      %.3f s\n", report.runSeconds);
+    printf("merge phase    %.3f s\n", report.mergeSeconds);
+    printf("throughput     %.1f MiB/s\n", seconds > 0 ? inputBytes / (1 << 20) / seconds : 0);
+
+    if (check) {
+        if (!verify(outPath, input))
+            return 1;
+        printf("verified       sorted, same keys as the input\n");
+    }
+    return 0;
+}
@@ -0,0 +1,519 @@
+// External (out-of-core) merge sort for files of 32-bit keys larger than
+// memory. Two phases:
+//   runs   the input is read a chunk at a time, each chunk is sorted in
+//          memory with adaptive_sort and written to its own temporary file
+//   merge  up to maxFanIn runs at a time are merged with a heap into one
+//          longer run, pass after pass, until the last pass writes the output
+// Every read and write goes through one I/O thread, and each stream has two
+// buffers, so the disk works on one buffer while the CPU sorts or merges
+// the other. Temporary files are unlinked as soon as they are created, so
+// they vanish even if the sort is killed.
+#ifndef EXTERNAL_SORT_H
+#define EXTERNAL_SORT_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "adaptive_sort.h"
+#include "sort_verify.h"
+
+#define EXTERNAL_DEFAULT_MEMORY (256 << 20)
+#define EXTERNAL_DEFAULT_BLOCK (1 << 20)
+#define EXTERNAL_DEFAULT_FAN_IN 64
+
+struct external_sort_config {
+    size_t memoryBytes = EXTERNAL_DEFAULT_MEMORY;   // Chunk and merge buffers together
+    size_t blockBytes = EXTERNAL_DEFAULT_BLOCK;     // Size of each read and write while merging
+    unsigned maxFanIn = EXTERNAL_DEFAULT_FAN_IN;    // Most runs merged at once
+    const char* tmpDir = "/tmp";
+    // If set, the first phase digests the input into it (see sort_verify.h)
+    // as each chunk arrives, before sorting it, so the output can be
+    // checked without reading the input again
+    verify_digest* inputDigest = NULL;
+};
+
+// What one external_sort call did, for tuning chunk and block sizes
+struct external_sort_report {
+    uint64_t keys;
+    uint64_t bytesRead;         // Input and temporary files together
+    uint64_t bytesWritten;      // Temporary files and output together
+    uint64_t chunkKeys;         // Most keys in one run of the first phase
+    unsigned runs;              // Sorted runs written by the first phase
+    unsigned fanIn;             // Runs merged at once, after the memory limit
+    unsigned passes;            // Passes over the data, the run phase included
+    double runSeconds;
+    double mergeSeconds;
+};
+
+// One read or write for the I/O thread
+struct io_request {
+    int fd;
+    char* buffer;
+    size_t bytes;
+    off_t offset;
+    bool write;
+    bool done;
+    int error;          // errno of a failed transfer, IO_SHORT if the file ended first
+    size_t transferred; // Bytes moved before it stopped
+};
+
+// io_request::error of a read that reached the end of the file
+#define IO_SHORT -1
+
+// A single thread doing pread/pwrite requests in the order they were
+// submitted. Since requests run in order, a buffer can be handed to a
+// read right after a write of the same buffer was submitted.
+class io_queue {
+public:
+    io_queue() : worker(&io_queue::worker_loop, this) {}
+
+    ~io_queue() {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            stopping = true;
+        }
+        changed.notify_all();
+        worker.join();
+    }
+
+    void submit(io_request* request) {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            request->done = false;
+            request->error = 0;
+            request->transferred = 0;
+            pending.push_back(request);
+        }
+        changed.notify_all();
+    }
+
+    // Blocks until request has run; returns false if it failed
+    bool wait(io_request* request) {
+        std::unique_lock<std::mutex> guard(lock);
+        changed.wait(guard, [request] { return request->done; });
+        return request->error == 0;
+    }
+
+private:
+    std::mutex lock;
+    std::condition_variable changed;
+    std::deque<io_request*> pending;
+    bool stopping = false;
+    std::thread worker;
+
+    // Returns 0, or the io_request::error to record
+    static int transfer(io_request* r) {
+        while (r->transferred < r->bytes) {
+            size_t const done = r->transferred;
+            ssize_t n = r->write ? pwrite(r->fd, r->buffer + done, r->bytes - done, r->offset + done)
+                                 : pread(r->fd, r->buffer + done, r->bytes - done, r->offset + done);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n < 0)
+                return errno;
+            if (n == 0)
+                return r->write ? EIO : IO_SHORT;
+            r->transferred += n;
+        }
+        return 0;
+    }
+
+    void worker_loop() {
+        std::unique_lock<std::mutex> guard(lock);
+        while (true) {
+            changed.wait(guard, [this] { return stopping || !pending.empty(); });
+            if (pending.empty())
+                return;
+            io_request* request = pending.front();
+            pending.pop_front();
+            guard.unlock();
+            int error = transfer(request);
+            guard.lock();
+            request->error = error;
+            request->done = true;
+            changed.notify_all();
+        }
+    }
+};
+
+// Waits for request and, if it failed, prints which transfer on file failed
+// and why. Returns false if it failed.
+static inline bool io_wait_reported(io_queue* io, io_request* request, const char* file) {
+    if (io->wait(request))
+        return true;
+    char what[512];
+    snprintf(what, sizeof(what), "%s: %s of %zu bytes at offset %lld (fd %d) stopped after %zu", file, request->write ? "write" : "read",
+             request->bytes, (long long)request->offset, request->fd, request->transferred);
+    if (request->error == IO_SHORT) {
+        fprintf(stderr, "%s: unexpected end of file\n", what);
+    } else {
+        errno = request->error;
+        perror(what);
+    }
+    return false;
+}
+
+// What io_wait_reported calls the temporary files
+#define EXTERNAL_TEMP_NAME "temporary run"
+
+// A sorted run on disk
+struct external_run {
+    int fd;
+    off_t offset;       // In keys
+    uint64_t keys;
+};
+
+// Creates an unlinked temporary file in dir; returns -1 on failure
+static inline int external_temp_file(const char* dir) {
+    std::string path = std::string(dir) + "/external_sort.XXXXXX";
+    int fd = mkstemp(&path[0]);
+    if (fd < 0) {
+        perror(path.c_str());
+        return -1;
+    }
+    unlink(path.c_str());
+    return fd;
+}
+
+// Streams one run through two buffers of blockKeys keys: the caller
+// consumes one while the I/O thread fills the other
+struct run_reader {
+    external_run run;
+    int32_t* buffer[2];
+    io_request request[2];
+    size_t blockKeys;
+    uint64_t nextKey;       // First key of the run not yet requested
+    int current;
+    size_t pos, len;        // Position in and length of buffer[current]
+};
+
+// Requests the next block of r->run into buffer b, if there is one
+static inline void reader_fetch(io_queue* io, run_reader* r, int b, external_sort_report* report) {
+    size_t keys = (size_t)std::min<uint64_t>(r->blockKeys, r->run.keys - r->nextKey);
+    r->request[b] = io_request{ r->run.fd, (char*)r->buffer[b], keys * sizeof(int32_t),
+                                (off_t)((r->run.offset + r->nextKey) * sizeof(int32_t)), false, false, 0, 0 };
+    r->nextKey += keys;
+    report->bytesRead += keys * sizeof(int32_t);
+    if (keys > 0)
+        io->submit(&r->request[b]);
+    else
+        r->request[b].done = true;
+}
+
+// Moves to the other buffer once the current one is used up. Returns false
+// at the end of the run or on a read error (with *failed set).
+static inline bool reader_advance(io_queue* io, run_reader* r, bool* failed, external_sort_report* report) {
+    if (r->pos < r->len)
+        return true;
+    int next = 1 - r->current;
+    if (!io_wait_reported(io, &r->request[next], EXTERNAL_TEMP_NAME)) {
+        *failed = true;
+        return false;
+    }
+    size_t keys = r->request[next].bytes / sizeof(int32_t);
+    if (keys == 0)
+        return false;
+    // The used-up buffer is free again: start reading the block after this one
+    reader_fetch(io, r, r->current, report);
+    r->current = next;
+    r->pos = 0;
+    r->len = keys;
+    return true;
+}
+
+// Collects keys into one of two blockKeys buffers and hands each full one
+// to the I/O thread while filling the other
+struct run_writer {
+    const char* name;   // For error messages
+    int fd;
+    off_t offset;       // In bytes
+    int32_t* buffer[2];
+    io_request request[2];
+    size_t blockKeys;
+    int current;
+    size_t len;
+};
+
+static inline bool writer_flush(io_queue* io, run_writer* w, external_sort_report* report) {
+    if (w->len == 0)
+        return true;
+    w->request[w->current] = io_request{ w->fd, (char*)w->buffer[w->current], w->len * sizeof(int32_t), w->offset, true, false, 0, 0 };
+    io->submit(&w->request[w->current]);
+    w->offset += w->len * sizeof(int32_t);
+    report->bytesWritten += w->len * sizeof(int32_t);
+    w->current = 1 - w->current;
+    w->len = 0;
+    // The buffer being switched to may still be on its way to disk
+    return io_wait_reported(io, &w->request[w->current], w->name);
+}
+
+static inline double external_seconds(const struct timespec& start) {
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+// Merges runs[0..k) into fd (called name in error messages) starting at
+// byte offset, using buffers of blockKeys keys carved out of memory (room
+// for 2 * (k + 1) blocks). A binary heap of (key, run) picks the next key.
+static inline bool external_merge(io_queue* io, const external_run* runs, size_t k, int fd, const char* name, off_t offset,
+                                  int32_t* memory, size_t blockKeys, external_sort_report* report) {
+    std::vector<run_reader> readers(k);
+    for (size_t r = 0; r < k; r++) {
+        run_reader& reader = readers[r];
+        reader.run = runs[r];
+        reader.buffer[0] = memory + 2 * r * blockKeys;
+        reader.buffer[1] = reader.buffer[0] + blockKeys;
+        reader.blockKeys = blockKeys;
+        reader.nextKey = 0;
+        // Start on an empty buffer 1 so the first advance waits for buffer 0
+        reader.current = 1;
+        reader.pos = reader.len = 0;
+        reader_fetch(io, &reader, 0, report);
+        reader.request[1] = io_request{ -1, NULL, 0, 0, false, true, 0, 0 };
+    }
+    run_writer writer;
+    writer.name = name;
+    writer.fd = fd;
+    writer.offset = offset;
+    writer.buffer[0] = memory + 2 * k * blockKeys;
+    writer.buffer[1] = writer.buffer[0] + blockKeys;
+    writer.request[0] = writer.request[1] = io_request{ -1, NULL, 0, 0, true, true, 0, 0 };
+    writer.blockKeys = blockKeys;
+    writer.current = 0;
+    writer.len = 0;
+
+    // Heap of the current key of each run, smallest on top; ties go to the
+    // lower run index so the merge is stable
+    std::vector<std::pair<int32_t, uint32_t>> heap;
+    bool failed = false;
+    for (size_t r = 0; r < k; r++)
+        if (reader_advance(io, &readers[r], &failed, report))
+            heap.push_back({ readers[r].buffer[readers[r].current][0], (uint32_t)r });
+    auto later = [](const std::pair<int32_t, uint32_t>& a, const std::pair<int32_t, uint32_t>& b) { return a > b; };
+    std::make_heap(heap.begin(), heap.end(), later);
+
+    while (!heap.empty() && !failed) {
+        std::pop_heap(heap.begin(), heap.end(), later);
+        run_reader& reader = readers[heap.back().second];
+        writer.buffer[writer.current][writer.len++] = heap.back().first;
+        if (writer.len == blockKeys && !writer_flush(io, &writer, report))
+            failed = true;
+
+        reader.pos++;
+        if (reader_advance(io, &reader, &failed, report)) {
+            heap.back().first = reader.buffer[reader.current][reader.pos];
+            std::push_heap(heap.begin(), heap.end(), later);
+        } else {
+            heap.pop_back();
+        }
+    }
+    if (!failed && !writer_flush(io, &writer, report))
+        failed = true;
+    // Nothing may still be writing from or reading into memory on return.
+    // Once something has failed the rest is only waited for.
+    for (int b = 0; b < 2; b++)
+        failed |= failed ? !io->wait(&writer.request[b]) : !io_wait_reported(io, &writer.request[b], name);
+    for (run_reader& reader : readers)
+        for (int b = 0; b < 2; b++)
+            io->wait(&reader.request[b]);
+    return !failed;
+}
+
+// Sorts the raw 32-bit keys in inPath into outPath (which may be the same
+// file). Returns false, having printed why, on any I/O or allocation error.
+static inline bool external_sort(const char* inPath, const char* outPath, const external_sort_config& config, external_sort_report* report) {
+    memset(report, 0, sizeof(*report));
+    if (config.inputDigest != NULL)
+        *config.inputDigest = verify_digest{ 0, 0, 0 };
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    int in = open(inPath, O_RDONLY);
+    if (in < 0) {
+        perror(inPath);
+        return false;
+    }
+    struct stat st;
+    if (fstat(in, &st) != 0) {
+        perror(inPath);
+        close(in);
+        return false;
+    }
+    report->keys = st.st_size / sizeof(int32_t);
+    if (st.st_size % sizeof(int32_t) != 0)
+        fprintf(stderr, "%s: ignoring %ld trailing bytes\n", inPath, (long)(st.st_size % sizeof(int32_t)));
+
+    // The run phase reads the next chunk while the current one is sorted
+    // and written, and the sort's scratch must fit in the budget too, so
+    // each chunk gets a third of the memory. The last third, and room for
+    // the digit histograms radix_sort would use on a chunk, is lent to the
+    // sort as its scratch reserve. (With a budget too small to spare the
+    // histograms, radix_sort falls back to std::sort.)
+    size_t const thirdKeys = std::max<size_t>(config.memoryBytes / 3 / sizeof(int32_t), 1);
+    size_t reserveExtra = radix_histogram_bytes(thirdKeys, 32);
+    if (config.memoryBytes < 4 * reserveExtra)
+        reserveExtra = 0;
+    // The histograms and the sort's buffer each start on a cache line
+    reserveExtra += 2 * 64;
+    size_t const chunkKeys = std::max<size_t>((config.memoryBytes - std::min(reserveExtra, config.memoryBytes)) / 3 / sizeof(int32_t), 1);
+    size_t const memoryKeys = std::max<size_t>(config.memoryBytes / sizeof(int32_t), 3 * chunkKeys);
+    report->chunkKeys = chunkKeys;
+    int32_t* memory = (int32_t*)malloc(memoryKeys * sizeof(int32_t));
+    if (memory == NULL) {
+        printf("Couldn't allocate %zu bytes of sort memory.\n", config.memoryBytes);
+        close(in);
+        return false;
+    }
+
+    io_queue io;
+    std::vector<external_run> runs;
+    bool ok = true;
+
+    // Phase 1: sorted runs. A single run goes straight to the output.
+    bool const singleRun = report->keys <= chunkKeys;
+    int out = -1;
+    if (singleRun) {
+        out = open(outPath, O_WRONLY | O_CREAT, 0644);
+        if (out < 0) {
+            perror(outPath);
+            ok = false;
+        }
+    }
+    // Each chunk has its own read and write request: the read into one
+    // chunk is submitted while the write from the other may still be
+    // queued. They all start out finished, so waiting on one never
+    // submitted returns at once.
+    io_request const finished = { -1, NULL, 0, 0, false, true, 0, 0 };
+    io_request reads[2] = { finished, finished }, writes[2] = { finished, finished };
+    int32_t* chunk[2] = { memory, memory + chunkKeys };
+    auto readChunk = [&](uint64_t first, int b) {
+        size_t keys = (size_t)std::min<uint64_t>(chunkKeys, report->keys - first);
+        reads[b] = io_request{ in, (char*)chunk[b], keys * sizeof(int32_t), (off_t)(first * sizeof(int32_t)), false, false, 0, 0 };
+        report->bytesRead += keys * sizeof(int32_t);
+        io.submit(&reads[b]);
+    };
+    if (ok && report->keys > 0)
+        readChunk(0, 0);
+    scratch_reserve_set(memory + 2 * chunkKeys, (memoryKeys - 2 * chunkKeys) * sizeof(int32_t));
+    for (uint64_t first = 0, b = 0; ok && first < report->keys; first += chunkKeys, b = 1 - b) {
+        if (!io_wait_reported(&io, &reads[b], inPath)) {
+            ok = false;
+            break;
+        }
+        size_t keys = reads[b].bytes / sizeof(int32_t);
+        // The other chunk's write may not have run yet, but the read into
+        // it is queued behind the write
+        if (first + keys < report->keys)
+            readChunk(first + keys, 1 - b);
+
+        if (config.inputDigest != NULL) {
+            bool sorted = true;
+            verify_scan(chunk[b], keys, false, &sorted, config.inputDigest);
+        }
+        adaptive_sort(chunk[b], keys);
+        int fd = singleRun ? out : external_temp_file(config.tmpDir);
+        if (fd < 0) {
+            ok = false;
+            break;
+        }
+        if (!singleRun)
+            runs.push_back(external_run{ fd, 0, keys });
+        // This chunk's last write was queued before the read just waited
+        // for, so it has finished: check it before reusing its request
+        if (!io_wait_reported(&io, &writes[b], singleRun ? outPath : EXTERNAL_TEMP_NAME)) {
+            ok = false;
+            break;
+        }
+        writes[b] = io_request{ fd, (char*)chunk[b], keys * sizeof(int32_t), 0, true, false, 0, 0 };
+        report->bytesWritten += keys * sizeof(int32_t);
+        io.submit(&writes[b]);
+    }
+    scratch_reserve_clear();
+    // Once something has failed the rest is only waited for
+    for (int b = 0; b < 2; b++) {
+        if (ok)
+            ok = io_wait_reported(&io, &reads[b], inPath) && io_wait_reported(&io, &writes[b], singleRun ? outPath : EXTERNAL_TEMP_NAME);
+        io.wait(&reads[b]);
+        io.wait(&writes[b]);
+    }
+    close(in);
+    report->runs = singleRun ? 1 : runs.size();
+    report->passes = 1;
+    report->runSeconds = external_seconds(start);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    // Phase 2: merge passes over the whole budget. Each run being merged
+    // needs two blocks and the output two more, which caps the fan-in.
+    size_t blockKeys = std::max<size_t>(config.blockBytes / sizeof(int32_t), 1);
+    blockKeys = std::max<size_t>(std::min(blockKeys, memoryKeys / 6), 1);
+    size_t fanIn = std::min<size_t>(config.maxFanIn, memoryKeys / (2 * blockKeys) - 1);
+    report->fanIn = fanIn;
+    if (ok && !singleRun && fanIn < 2) {
+        fprintf(stderr, "Not enough memory to merge two runs of %zu-byte blocks\n", blockKeys * sizeof(int32_t));
+        ok = false;
+    }
+
+    while (ok && runs.size() > 1) {
+        bool const last = runs.size() <= fanIn;
+        std::vector<external_run> merged;
+        for (size_t r = 0; ok && r < runs.size(); r += fanIn) {
+            size_t k = std::min(fanIn, runs.size() - r);
+            int fd = last ? open(outPath, O_WRONLY | O_CREAT, 0644) : external_temp_file(config.tmpDir);
+            if (fd < 0) {
+                if (last)
+                    perror(outPath);
+                ok = false;
+                break;
+            }
+            uint64_t keys = 0;
+            for (size_t i = r; i < r + k; i++)
+                keys += runs[i].keys;
+            // A run left over on its own is merged (copied) like the others,
+            // so every run of the next pass is in its own file
+            ok = external_merge(&io, &runs[r], k, fd, last ? outPath : EXTERNAL_TEMP_NAME, 0, memory, blockKeys, report);
+            for (size_t i = r; i < r + k; i++) {
+                close(runs[i].fd);
+                runs[i].fd = -1;
+            }
+            if (last)
+                out = fd;
+            else
+                merged.push_back(external_run{ fd, 0, keys });
+        }
+        // Runs a failure left unmerged are dropped with their files
+        for (const external_run& run : runs)
+            if (run.fd >= 0)
+                close(run.fd);
+        runs.swap(merged);
+        report->passes++;
+    }
+    for (const external_run& run : runs)
+        close(run.fd);
+
+    if (out >= 0) {
+        if (ok && ftruncate(out, report->keys * sizeof(int32_t)) != 0) {
+            perror(outPath);
+            ok = false;
+        }
+        close(out);
+    }
+    report->mergeSeconds = external_seconds(start);
+    free(memory);
+    return ok;
+}
+
+#endif
@@ -0,0 +1,280 @@
+// g++ -Wall -Wpedantic -march=haswell -O3 -pthread file_sort.cpp -o file_sort
+// ./file_sort --generate 100000000 --type int64 --order wide_random --out keys.bin
+// ./file_sort --in keys.bin --algo auto
+// Sorts a key file (see key_file.h) on its mapped pages: in place, or into a
+// separate output file with --out. Reports the time of each phase and the
+// page faults taken during the sort.
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
+#include <algorithm>
+#include <type_traits>
+#include "sort_inputs.h"
+#include "adaptive_sort.h"
+#include "radix_sort.h"
+#include "timsort.h"
+#include "typed_sort.h"
+#include "key_file.h"
+#include "sort_verify.h"
+
+void autoSortInt32(int32_t* a, size_t n) { adaptive_sort(a, n); }
+template <typename T> void radixSortAll(T* a, size_t n) { radix_sort(a, n); }
+template <typename T> void quickSortAll(T* a, size_t n) { typed::quick_sort(a, n); }
+template <typename T> void mergeSortAll(T* a, size_t n) { typed::merge_sort(a, n); }
+template <typename T> void timSortAll(T* a, size_t n) { typed::tim_sort(a, n); }
+template <typename T> void inplaceMergeSortAll(T* a, size_t n) { typed::inplace_merge_sort(a, n); }
+void timSortInt32(int32_t* a, size_t n) { timSort(a, n); }
+template <typename T> void stdSortAll(T* a, size_t n) { std::sort(a, a + n); }
+
+// One sort for each key type a file can hold, NULL where it doesn't apply
+struct file_algorithm {
+    const char* name;
+    bool randomAccess;      // Writes the keys out of order (radix scatter)
+    void (*sortInt32)(int32_t*, size_t);
+    void (*sortInt64)(int64_t*, size_t);
+    void (*sortFloat)(float*, size_t);
+    void (*sortDouble)(double*, size_t);
+};
+
+static const file_algorithm file_algorithms[] = {
+    // adaptive_sort for int32, radix for int64, introsort for floating point
+    { "auto", true, autoSortInt32, radixSortAll<int64_t>, quickSortAll<float>, quickSortAll<double> },
+    { "radix_sort", true, radixSortAll<int32_t>, radixSortAll<int64_t>, NULL, NULL },
+    { "quick_sort", false, quickSortAll<int32_t>, quickSortAll<int64_t>, quickSortAll<float>, quickSortAll<double> },
+    { "merge_sort", false, mergeSortAll<int32_t>, mergeSortAll<int64_t>, mergeSortAll<float>, mergeSortAll<double> },
+    { "tim_sort", false, timSortInt32, timSortAll<int64_t>, timSortAll<float>, timSortAll<double> },
+    // Stable with about sqrt(n) scratch, for files that nearly fill memory
+    { "inplace_merge_sort", false, inplaceMergeSortAll<int32_t>, inplaceMergeSortAll<int64_t>, inplaceMergeSortAll<float>,
+      inplaceMergeSortAll<double> },
+    { "std_sort", false, stdSortAll<int32_t>, stdSortAll<int64_t>, stdSortAll<float>, stdSortAll<double> },
+};
+#define FILE_ALGORITHMS (sizeof(file_algorithms) / sizeof(file_algorithms[0]))
+
+// Sorts the keys of kf with sort and checks the result against a digest of
+// the keys taken before
+template <typename T>
+verify_result sort_keys(void (*sort)(T*, size_t), key_file* kf) {
+    T* keys = (T*)kf->keys;
+    size_t n = kf->header->count;
+    verify_digest const input = verify_fingerprint(keys, n);
+    sort(keys, n);
+    return verify_sorted(keys, n, input);
+}
+
+double seconds_since(struct timespec* start) {
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double s = (end.tv_sec - start->tv_sec) + (end.tv_nsec - start->tv_nsec) / 1e9;
+    *start = end;
+    return s;
+}
+
+// Fills the keys of kf from create_array, in the given ordering.
+// wide_random int64 keys take all 64 bits from the generator instead, as in
+// the benchmark.
+template <typename T>
+bool fill_keys(key_file* kf, array_ordering order, unsigned seed) {
+    T* keys = (T*)kf->keys;
+    if (std::is_same<T, int64_t>::value && order == WIDE_RANDOM) {
+        input_for(kf->header->count, [&](size_t, size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++)
+                keys[i] = (T)input_wide64(seed, i);
+        });
+        return true;
+    }
+    DATA_T* source = create_array(kf->header->count, order, seed);
+    if (source == NULL)
+        return false;
+    for (uint64_t i = 0; i < kf->header->count; i++)
+        keys[i] = (T)source[i];
+    free(source);
+    return true;
+}
+
+bool generate(const char* path, key_file_type type, uint64_t count, array_ordering order, unsigned seed, bool hugePages) {
+    key_file kf;
+    if (!key_file_create(path, type, count, hugePages, &kf))
+        return false;
+    key_file_advise(&kf, ADVISE_SEQUENTIAL);
+    bool ok = false;
+    switch (type) {
+    case KEY_FILE_INT32: ok = fill_keys<int32_t>(&kf, order, seed); break;
+    case KEY_FILE_INT64: ok = fill_keys<int64_t>(&kf, order, seed); break;
+    case KEY_FILE_FLOAT: ok = fill_keys<float>(&kf, order, seed); break;
+    case KEY_FILE_DOUBLE: ok = fill_keys<double>(&kf, order, seed); break;
+    }
+    return key_file_close(&kf, true) && ok;
+}
+
+void usage() {
+    printf("Usage: file_sort --in file [--out file] [options]\n"
+           "       file_sort --generate count --out file [--type t] [--order o] [--seed n]\n"
+           "  --algo a           sort to use (default auto)\n"
+           "  --huge on|off      ask for transparent huge pages on the mapping (default on)\n"
+           "  --sync on|off      msync the sorted keys before exiting (default on)\n"
+           "  --type t           key type for --generate: int32, int64, float or double\n"
+           "Without --out the input is sorted in place.\n"
+           "Algorithms:");
+    for (size_t a = 0; a < FILE_ALGORITHMS; a++)
+        printf(" %s", file_algorithms[a].name);
+    printf("\nOrderings:");
+    for (int o = 0; o < ARRAY_ORDERINGS; o++)
+        printf(" %s", array_ordering_names[o]);
+    printf("\n");
+}
+
+int main(int argc, char* argv[]) {
+    const char* inPath = NULL;
+    const char* outPath = NULL;
+    const file_algorithm* algo = &file_algorithms[0];
+    key_file_type type = KEY_FILE_INT32;
+    array_ordering order = WIDE_RANDOM;
+    uint64_t generateCount = 0;
+    unsigned seed = 1;
+    bool hugePages = true, sync = true;
+
+    for (int i = 1; i < argc; i++) {
+        const char* opt = argv[i];
+        if (strcmp(opt, "--help") == 0) {
+            usage();
+            return 0;
+        }
+        if (i + 1 >= argc) {
+            fprintf(stderr, "Missing value for %s\n", opt);
+            usage();
+            return 1;
+        }
+        const char* value = argv[++i];
+        bool good = true;
+        if (strcmp(opt, "--in") == 0) {
+            inPath = value;
+        } else if (strcmp(opt, "--out") == 0) {
+            outPath = value;
+        } else if (strcmp(opt, "--algo") == 0) {
+            algo = NULL;
+            for (size_t a = 0; a < FILE_ALGORITHMS; a++)
+                if (strcmp(value, file_algorithms[a].name) == 0)
+                    algo = &file_algorithms[a];
+            good = algo != NULL;
+        } else if (strcmp(opt, "--huge") == 0) {
+            hugePages = strcmp(value, "off") != 0;
+        } else if (strcmp(opt, "--sync") == 0) {
+            sync = strcmp(value, "off") != 0;
+        } else if (strcmp(opt, "--type") == 0) {
+            int t = 1;
+            while (t < KEY_FILE_TYPES && strcmp(value, key_file_type_names[t]) != 0)
+                t++;
+            good = t < KEY_FILE_TYPES;
+            type = (key_file_type)t;
+        } else if (strcmp(opt, "--order") == 0) {
+            int o = 0;
+            while (o < ARRAY_ORDERINGS && strcmp(value, array_ordering_names[o]) != 0)
+                o++;
+            good = o < ARRAY_ORDERINGS;
+            order = (array_ordering)o;
+        } else if (strcmp(opt, "--generate") == 0) {
+            generateCount = strtoull(value, NULL, 10);
+            good = generateCount > 0;
+        } else if (strcmp(opt, "--seed") == 0) {
+            seed = atoi(value);
+        } else {
+            fprintf(stderr, "Unknown option %s\n", opt);
+            usage();
+            return 1;
+        }
+        if (!good) {
+            fprintf(stderr, "Bad value for %s: %s\n", opt, value);
+            return 1;
+        }
+    }
+
+    if (generateCount > 0) {
+        if (outPath == NULL) {
+            usage();
+            return 1;
+        }
+        return generate(outPath, type, generateCount, order, seed, hugePages) ? 0 : 1;
+    }
+    if (inPath == NULL) {
+        usage();
+        return 1;
+    }
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    key_file in, out;
+    if (!key_file_open(inPath, outPath == NULL, hugePages, &in))
+        return 1;
+    bool available = false;
+    switch (in.header->type) {
+    case KEY_FILE_INT32: available = algo->sortInt32 != NULL; break;
+    case KEY_FILE_INT64: available = algo->sortInt64 != NULL; break;
+    case KEY_FILE_FLOAT: available = algo->sortFloat != NULL; break;
+    case KEY_FILE_DOUBLE: available = algo->sortDouble != NULL; break;
+    }
+    if (!available) {
+        fprintf(stderr, "%s can't sort %s keys\n", algo->name, key_file_type_names[in.header->type]);
+        key_file_close(&in, false);
+        return 1;
+    }
+    key_file* target = &in;
+    if (outPath != NULL) {
+        // The one copy: input pages straight into the output mapping
+        if (!key_file_create(outPath, (key_file_type)in.header->type, in.header->count, hugePages, &out))
+            return 1;
+        key_file_advise(&in, ADVISE_SEQUENTIAL);
+        key_file_advise(&out, ADVISE_SEQUENTIAL);
+        memcpy(out.keys, in.keys, in.header->count * key_file_type_bytes[in.header->type]);
+        key_file_close(&in, false);
+        target = &out;
+    } else {
+        key_file_advise(&in, ADVISE_LOAD);
+    }
+    double const mapSeconds = seconds_since(&start);
+
+    // Scattered writes would only waste readahead
+    key_file_advise(target, algo->randomAccess ? ADVISE_RANDOM : ADVISE_SEQUENTIAL);
+    struct rusage before, after;
+    getrusage(RUSAGE_SELF, &before);
+    verify_result verified = VERIFY_UNSORTED;
+    switch (target->header->type) {
+    case KEY_FILE_INT32: verified = sort_keys(algo->sortInt32, target); break;
+    case KEY_FILE_INT64: verified = sort_keys(algo->sortInt64, target); break;
+    case KEY_FILE_FLOAT: verified = sort_keys(algo->sortFloat, target); break;
+    case KEY_FILE_DOUBLE: verified = sort_keys(algo->sortDouble, target); break;
+    }
+    getrusage(RUSAGE_SELF, &after);
+    double const sortSeconds = seconds_since(&start);
+    key_file_advise(target, ADVISE_NORMAL);
+
+    key_file_type const fileType = (key_file_type)target->header->type;
+    uint64_t const count = target->header->count;
+    key_file_pages const pages = target->pages;
+    uint64_t const hugeBytes = key_file_huge_bytes(target);
+    bool const synced = key_file_close(target, sync);
+    double const syncSeconds = seconds_since(&start);
+
+    printf("keys         %lu %s (%.1f MiB)\n", count, key_file_type_names[fileType],
+           count * key_file_type_bytes[fileType] / (double)(1 << 20));
+    printf("algorithm    %s\n", algo->name);
+    printf("pages        %s, %.1f of %.1f MiB on huge pages\n", key_file_pages_names[pages], hugeBytes / (double)(1 << 20),
+           count * key_file_type_bytes[fileType] / (double)(1 << 20));
+    printf("map%s  %.3f s\n", outPath ? "+copy" : "     ", mapSeconds);
+    printf("sort         %.3f s (%ld minor, %ld major faults)\n", sortSeconds, after.ru_minflt - before.ru_minflt,
+           after.ru_majflt - before.ru_majflt);
+    printf("sync         %.3f s%s\n", syncSeconds, sync ? "" : " (skipped)");
+    if (verified != VERIFY_OK) {
+        fprintf(stderr, "%s left the keys %s\n", algo->name, verify_result_names[verified]);
+        return 1;
+    }
+    if (!synced) {
+        perror("msync");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,253 @@
+// g++ -Wall -Wpedantic -march=haswell -O3 -pthread ingest_benchmark.cpp -o ingest_benchmark
+// ./ingest_benchmark --size 4000000 --ratio 0.0001,0.001,0.01,0.1,1 --batches 16
+// Times keeping a growing array sorted as batches arrive: sorted_ingest.h
+// against appending each batch and sorting everything again. The array
+// starts with --size sorted keys, then --batches batches of --ratio times
+// that many keys arrive, and the keys must be in order after every batch
+// (or, for ingest_lazy, only after the last one).
+// Get modern behaviour out of time.h, per https://stackoverflow.com/a/40515669
+#define _POSIX_C_SOURCE 199309L
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "sort_inputs.h"
+#include "sorted_ingest.h"
+
+// One way of keeping the array sorted. Loads the resident keys, then
+// takes every batch, leaving the final keys in out. Returns the seconds
+// spent on the batches alone.
+typedef double (*ingest_strategy_fn)(const std::vector<int32_t>& resident, const std::vector<std::vector<int32_t>>& batches,
+                                     std::vector<int32_t>* out);
+
+double now_seconds() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+// Sorted after every batch
+double ingestEager(const std::vector<int32_t>& resident, const std::vector<std::vector<int32_t>>& batches, std::vector<int32_t>* out) {
+    sorted_ingest si;
+    ingest_init(&si);
+    ingest_batch(&si, resident.data(), resident.size());
+    ingest_sorted(&si);
+    double const start = now_seconds();
+    for (const std::vector<int32_t>& batch : batches) {
+        ingest_batch(&si, batch.data(), batch.size());
+        ingest_sorted(&si);
+    }
+    double const seconds = now_seconds() - start;
+    out->assign(si.keys, si.keys + si.size);
+    ingest_free(&si);
+    return seconds;
+}
+
+// Sorted only at the end; runs are merged as the stack invariants require
+double ingestLazy(const std::vector<int32_t>& resident, const std::vector<std::vector<int32_t>>& batches, std::vector<int32_t>* out) {
+    sorted_ingest si;
+    ingest_init(&si);
+    ingest_batch(&si, resident.data(), resident.size());
+    double const start = now_seconds();
+    for (const std::vector<int32_t>& batch : batches)
+        ingest_batch(&si, batch.data(), batch.size());
+    const int32_t* keys = ingest_sorted(&si);
+    double const seconds = now_seconds() - start;
+    out->assign(keys, keys + si.size);
+    ingest_free(&si);
+    return seconds;
+}
+
+// Append and sort everything again, after every batch
+template <void (*Sort)(int32_t*, size_t)>
+double resortEach(const std::vector<int32_t>& resident, const std::vector<std::vector<int32_t>>& batches, std::vector<int32_t>* out) {
+    *out = resident;
+    Sort(out->data(), out->size());
+    double const start = now_seconds();
+    for (const std::vector<int32_t>& batch : batches) {
+        out->insert(out->end(), batch.begin(), batch.end());
+        Sort(out->data(), out->size());
+    }
+    return now_seconds() - start;
+}
+
+void adaptiveSortAll(int32_t* a, size_t n) { adaptive_sort(a, n); }
+void timSortAll(int32_t* a, size_t n) { timSort(a, n); }
+
+struct ingest_strategy {
+    const char* name;
+    ingest_strategy_fn run;
+};
+
+// resort_adaptive comes first: the other times are reported relative to it
+static const ingest_strategy strategies[] = {
+    { "resort_adaptive", resortEach<adaptiveSortAll> },
+    { "resort_timSort", resortEach<timSortAll> },
+    { "ingest", ingestEager },
+    { "ingest_lazy", ingestLazy },
+};
+#define STRATEGIES (sizeof(strategies) / sizeof(strategies[0]))
+
+struct ingest_config {
+    uint64_t size = 4000000;
+    std::vector<double> ratios;
+    unsigned batches = 16;
+    array_ordering order = RANDOM;
+    unsigned reps = 3;
+    unsigned seed = 1;
+    bool csv = false;
+};
+
+// Time in seconds of strategy's fastest of reps runs, or -1 if its final
+// keys aren't sorted
+double time_strategy(const ingest_strategy& strategy, const std::vector<int32_t>& resident,
+                     const std::vector<std::vector<int32_t>>& batches, const std::vector<int32_t>& expected, unsigned reps) {
+    double best = -1;
+    for (unsigned rep = 0; rep < reps; rep++) {
+        std::vector<int32_t> out;
+        double const seconds = strategy.run(resident, batches, &out);
+        if (out != expected)
+            return -1;
+        if (best < 0 || seconds < best)
+            best = seconds;
+    }
+    return best;
+}
+
+void usage() {
+    printf("Usage: ingest_benchmark [options]\n"
+           "  --size n           sorted keys resident before the batches (default 4000000)\n"
+           "  --ratio r,...      batch size as a fraction of --size (default 0.0001,0.001,0.01,0.1,1)\n"
+           "  --batches n        batches per run (default 16)\n"
+           "  --order o          ordering of the keys in each batch (default random)\n"
+           "  --reps n           runs per strategy; the fastest is reported (default 3)\n"
+           "  --seed n           seed for the inputs (default 1)\n"
+           "  --format f         table or csv (default table)\n"
+           "Strategies:");
+    for (size_t s = 0; s < STRATEGIES; s++)
+        printf(" %s", strategies[s].name);
+    printf("\nOrderings:");
+    for (int o = 0; o < ARRAY_ORDERINGS; o++)
+        printf(" %s", array_ordering_names[o]);
+    printf("\n");
+}
+
+bool parse_args(int argc, char* argv[], ingest_config* config) {
+    for (int i = 1; i < argc; i++) {
+        const char* opt = argv[i];
+        if (strcmp(opt, "--help") == 0) {
+            usage();
+            exit(0);
+        }
+        if (i + 1 >= argc) {
+            fprintf(stderr, "Missing value for %s\n", opt);
+            return false;
+        }
+        const char* value = argv[++i];
+        bool good = true;
+        if (strcmp(opt, "--size") == 0) {
+            config->size = strtoull(value, NULL, 10);
+            good = config->size > 0;
+        } else if (strcmp(opt, "--ratio") == 0) {
+            for (const char* c = value; *c;) {
+                char* end;
+                config->ratios.push_back(strtod(c, &end));
+                good = good && end != c && config->ratios.back() > 0;
+                c = *end == ',' ? end + 1 : end;
+                if (*end != ',' && *end != '\0') {
+                    good = false;
+                    break;
+                }
+            }
+        } else if (strcmp(opt, "--batches") == 0) {
+            config->batches = atoi(value);
+            good = config->batches > 0;
+        } else if (strcmp(opt, "--order") == 0) {
+            int o = 0;
+            while (o < ARRAY_ORDERINGS && strcmp(value, array_ordering_names[o]) != 0)
+                o++;
+            good = o < ARRAY_ORDERINGS;
+            config->order = (array_ordering)o;
+        } else if (strcmp(opt, "--reps") == 0) {
+            config->reps = atoi(value);
+            good = config->reps > 0;
+        } else if (strcmp(opt, "--seed") == 0) {
+            config->seed = atoi(value);
+        } else if (strcmp(opt, "--format") == 0) {
+            config->csv = strcmp(value, "csv") == 0;
+        } else {
+            fprintf(stderr, "Unknown option %s\n", opt);
+            return false;
+        }
+        if (!good) {
+            fprintf(stderr, "Bad value for %s: %s\n", opt, value);
+            return false;
+        }
+    }
+    if (config->ratios.empty())
+        config->ratios = { 0.0001, 0.001, 0.01, 0.1, 1 };
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    ingest_config config;
+    if (!parse_args(argc, argv, &config)) {
+        usage();
+        return 1;
+    }
+
+    DATA_T* source = create_array(config.size, RANDOM, config.seed);
+    if (source == NULL) {
+        fprintf(stderr, "Couldn't allocate %lu keys\n", config.size);
+        return 1;
+    }
+    std::vector<int32_t> resident(source, source + config.size);
+    free(source);
+    std::sort(resident.begin(), resident.end());
+
+    if (config.csv)
+        printf("strategy,resident,ratio,batch,batches,total_ms,ns_per_batch_key,speedup_vs_resort\n");
+    else
+        printf("%-16s %10s %8s %9s %7s %10s %12s %10s\n", "strategy", "resident", "ratio", "batch", "batches", "total", "ns/batch key",
+               "vs resort");
+
+    for (double ratio : config.ratios) {
+        size_t const batchKeys = std::max<size_t>(1, (size_t)(ratio * config.size));
+        std::vector<std::vector<int32_t>> batches;
+        std::vector<int32_t> expected = resident;
+        for (unsigned b = 0; b < config.batches; b++) {
+            DATA_T* keys = create_array(batchKeys, config.order, config.seed + 1 + b);
+            if (keys == NULL) {
+                fprintf(stderr, "Couldn't allocate %zu keys\n", batchKeys);
+                return 1;
+            }
+            batches.emplace_back(keys, keys + batchKeys);
+            expected.insert(expected.end(), keys, keys + batchKeys);
+            free(keys);
+        }
+        std::sort(expected.begin(), expected.end());
+
+        double resortSeconds = 0;
+        for (size_t s = 0; s < STRATEGIES; s++) {
+            double seconds = time_strategy(strategies[s], resident, batches, expected, config.reps);
+            if (seconds < 0) {
+                fprintf(stderr, "%s left the keys unsorted\n", strategies[s].name);
+                return 1;
+            }
+            if (s == 0)
+                resortSeconds = seconds;
+            double const nsPerKey = seconds * 1e9 / ((double)batchKeys * config.batches);
+            if (config.csv)
+                printf("%s,%lu,%g,%zu,%u,%.4f,%.2f,%.2f\n", strategies[s].name, config.size, ratio, batchKeys, config.batches,
+                       seconds * 1000, nsPerKey, resortSeconds / seconds);
+            else
+                printf("%-16s %10lu %8g %9zu %7u %7.2f ms %12.2f %9.1fx\n", strategies[s].name, config.size, ratio, batchKeys,
+                       config.batches, seconds * 1000, nsPerKey, resortSeconds / seconds);
+        }
+    }
+    return 0;
+}
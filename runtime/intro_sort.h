@@ -0,0 +1,147 @@
+// Introsort on 32-bit keys: ninther pivots, 3-way partitioning, a heapsort
+// fallback and the sorting network for small ranges. Also the base of
+// parallelQuickSort and the quicksort path of adaptive_sort.h.
+#ifndef INTRO_SORT_H
+#define INTRO_SORT_H
+
+#include <stdint.h>
+#include <algorithm>
+#include "simd_sort_network.h"
+#include "sort_tuning.h"
+
+// Ranges above this size pick their pivot with Tukey's ninther
+#define NINTHER_THRESHOLD 128
+
+// Returns the index of the median of arr[a], arr[b] and arr[c]
+static inline uint64_t medianOf3(int32_t arr[], uint64_t a, uint64_t b, uint64_t c) {
+    if (arr[a] < arr[b]) {
+        if (arr[b] < arr[c])
+            return b;
+        return arr[a] < arr[c] ? c : a;
+    }
+    if (arr[a] < arr[c])
+        return a;
+    return arr[b] < arr[c] ? c : b;
+}
+
+// Median of 3 for mid-sized ranges, median of 3 medians (ninther) for large ones
+static inline uint64_t choosePivot(int32_t arr[], uint64_t start, uint64_t end) {
+    uint64_t mid = start + (end - start) / 2;
+    if (end - start + 1 <= NINTHER_THRESHOLD)
+        return medianOf3(arr, start, mid, end);
+    uint64_t step = (end - start + 1) / 8;
+    uint64_t a = medianOf3(arr, start, start + step, start + 2 * step);
+    uint64_t b = medianOf3(arr, mid - step, mid, mid + step);
+    uint64_t c = medianOf3(arr, end - 2 * step, end - step, end);
+    return medianOf3(arr, a, b, c);
+}
+
+// 3-way (Dijkstra) partition around arr[pivotIndex]. On return
+// arr[start..*lt-1] < pivot, arr[*lt..*gt] == pivot, arr[*gt+1..end] > pivot,
+// so a run of equal keys is finished in this one pass
+static inline void partition3Way(int32_t arr[], uint64_t start, uint64_t end, uint64_t pivotIndex, uint64_t* lt, uint64_t* gt) {
+    int32_t pivot = arr[pivotIndex];
+    uint64_t l = start, i = start, g = end;
+    while (i <= g) {
+        if (arr[i] < pivot) {
+            std::swap(arr[l++], arr[i++]);
+        } else if (arr[i] > pivot) {
+            // g never passes the pivot's own slot, so it can't wrap below start
+            std::swap(arr[i], arr[g--]);
+        } else {
+            i++;
+        }
+    }
+    *lt = l;
+    *gt = g;
+}
+
+// Moves arr[start + root] down the max-heap stored in arr[start..start+size-1]
+static inline void siftDown(int32_t arr[], uint64_t start, uint64_t root, uint64_t size) {
+    int32_t value = arr[start + root];
+    uint64_t child;
+    while ((child = 2 * root + 1) < size) {
+        if (child + 1 < size && arr[start + child] < arr[start + child + 1])
+            child++;
+        if (arr[start + child] <= value)
+            break;
+        arr[start + root] = arr[start + child];
+        root = child;
+    }
+    arr[start + root] = value;
+}
+
+// O(n log n) worst-case fallback for ranges where quicksort keeps picking bad pivots
+static inline void heapSort(int32_t arr[], uint64_t start, uint64_t end) {
+    uint64_t size = end - start + 1;
+    for (uint64_t i = size / 2; i-- > 0;)
+        siftDown(arr, start, i, size);
+    for (uint64_t last = size - 1; last > 0; last--) {
+        std::swap(arr[start], arr[start + last]);
+        siftDown(arr, start, 0, last);
+    }
+}
+
+// Recurses only into the smaller side and loops on the larger one,
+// so the stack depth stays below log2(n). Ranges of at most Cutoff keys
+// (see sort_tuning.h) are left to sort_int32_network.
+template <uint64_t Cutoff>
+static inline void introSortLoopCutoff(int32_t arr[], uint64_t start, uint64_t end, int depthLimit) {
+    while (end - start + 1 > Cutoff) {
+        if (depthLimit == 0) {
+            heapSort(arr, start, end);
+            return;
+        }
+        depthLimit--;
+
+        uint64_t lt, gt;
+        partition3Way(arr, start, end, choosePivot(arr, start, end), &lt, &gt);
+        if (lt - start < end - gt) {
+            if (lt > start)
+                introSortLoopCutoff<Cutoff>(arr, start, lt - 1, depthLimit);
+            if (gt >= end)
+                return;
+            start = gt + 1;
+        } else {
+            if (gt < end)
+                introSortLoopCutoff<Cutoff>(arr, gt + 1, end, depthLimit);
+            if (lt <= start)
+                return;
+            end = lt - 1;
+        }
+    }
+    sort_int32_network(arr + start, end - start + 1);
+}
+
+typedef void (*intro_sort_loop_fn)(int32_t*, uint64_t, uint64_t, int);
+
+// introSortLoopCutoff for one of sort_tuning.h's tuning_cutoffs
+static inline intro_sort_loop_fn introsort_for_cutoff(uint64_t cutoff) {
+    switch (cutoff) {
+    case 8: return introSortLoopCutoff<8>;
+    case 16: return introSortLoopCutoff<16>;
+    case 24: return introSortLoopCutoff<24>;
+    case 32: return introSortLoopCutoff<32>;
+    case 48: return introSortLoopCutoff<48>;
+    default: return introSortLoopCutoff<64>;
+    }
+}
+
+// introSortLoopCutoff with the machine's tuned cutoff, picked on the first call
+static inline void introSortLoop(int32_t arr[], uint64_t start, uint64_t end, int depthLimit) {
+    static const intro_sort_loop_fn tuned = introsort_for_cutoff(sort_tuning_get().introSortCutoff);
+    tuned(arr, start, end, depthLimit);
+}
+
+// Introsort: quicksort with ninther pivots and 3-way partitioning that
+// falls back to heapsort after 2*log2(n) levels
+static inline void introSort(int32_t arr[], uint64_t start, uint64_t end) {
+    if (start >= end)
+        return;
+    int depthLimit = 0;
+    for (uint64_t n = end - start + 1; n > 1; n >>= 1)
+        depthLimit += 2;
+    introSortLoop(arr, start, end, depthLimit);
+}
+
+#endif
@@ -0,0 +1,418 @@
+// g++ -Wall -Wpedantic -march=haswell -O3 -pthread kernel_benchmark.cpp -o kernel_benchmark
+// ./kernel_benchmark --family merge --size 4096,524288 --skew 1,8
+// Times the building blocks of the sorts on their own: the merge kernels,
+// the partition functions and the small-array sorts. Each kernel is run on
+// the same seeded input, restored before every repetition, at sizes either
+// side of each cache level, and reported as ns and cycles per element.
+// Get modern behaviour out of time.h, per https://stackoverflow.com/a/40515669
+#define _POSIX_C_SOURCE 199309L
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <x86intrin.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "sort_inputs.h"
+#include "simd_merge.h"
+#include "simd_sort_network.h"
+#include "intro_sort.h"
+#include "quick_sort.h"
+#include "timsort.h"
+#include "perf_counters.h"
+
+// Per-core cache sizes of the machine in Data/cache_runtime_data.txt,
+// used to label which level a working set fits in
+#define L1D_BYTES (32 << 10)
+#define L2_BYTES (256 << 10)
+#define L3_BYTES (9 << 20)
+
+// Everything a kernel reads, built once per configuration
+struct kernel_input {
+    std::vector<int32_t> keys;
+    size_t split;       // merge: length of the first run; small: keys per sort
+    int32_t pivot;      // partition: the pivot, also stored at keys[0]
+};
+
+// Runs the kernel on work (a fresh copy of in.keys); out has room for
+// as many keys again
+typedef void (*kernel_fn)(const kernel_input& in, int32_t* work, int32_t* out);
+
+enum kernel_family { MERGE, PARTITION, SMALL_SORT };
+static const char* const kernel_family_names[] = { "merge", "partition", "small" };
+
+struct kernel {
+    kernel_family family;
+    const char* name;
+    kernel_fn run;
+    bool needsAvx2;
+};
+
+// Merges
+
+void mergeScalarKernel(const kernel_input& in, int32_t* work, int32_t* out) {
+    merge_int32_scalar(work, in.split, work + in.split, in.keys.size() - in.split, out);
+}
+
+void mergeAvx2Kernel(const kernel_input& in, int32_t* work, int32_t* out) {
+    merge_int32_avx2(work, in.split, work + in.split, in.keys.size() - in.split, out);
+}
+
+// timSort's merge of two adjacent runs, using out as its scratch
+void timsortMerge(const kernel_input& in, int32_t* work, int32_t* out) {
+    timsort_state ts;
+    ts.arr = work;
+    ts.tmp.buffer = out;
+    ts.tmp.capacity = in.keys.size();
+    ts.minGallop = MIN_GALLOP;
+    ts.runBase[0] = 0;
+    ts.runLen[0] = in.split;
+    ts.runBase[1] = in.split;
+    ts.runLen[1] = in.keys.size() - in.split;
+    ts.stackSize = 2;
+    merge(&ts, 0);
+}
+
+void mergeGallopKernel(const kernel_input& in, int32_t* work, int32_t* out) {
+    simd_merge_enabled = false;
+    timsortMerge(in, work, out);
+    simd_merge_enabled = true;
+}
+
+void mergeTimsortKernel(const kernel_input& in, int32_t* work, int32_t* out) {
+    timsortMerge(in, work, out);
+}
+
+// Partitions, all around the pivot at work[0]
+
+void partitionKernel(const kernel_input& in, int32_t* work, int32_t*) {
+    partition(work, 0, in.keys.size() - 1);
+}
+
+void partitionBlockKernel(const kernel_input& in, int32_t* work, int32_t*) {
+    partitionBlock(work, 0, in.keys.size() - 1);
+}
+
+void partition3WayKernel(const kernel_input& in, int32_t* work, int32_t*) {
+    uint64_t lt, gt;
+    partition3Way(work, 0, in.keys.size() - 1, 0, &lt, &gt);
+}
+
+void partitionChunkKernel(const kernel_input& in, int32_t* work, int32_t*) {
+    partitionChunk<false>(work, 0, in.keys.size(), in.pivot);
+}
+
+// Small sorts, one after another over in.split keys at a time
+
+void insertionSortKernel(const kernel_input& in, int32_t* work, int32_t*) {
+    for (size_t i = 0; i + in.split <= in.keys.size(); i += in.split)
+        insertion_sort_int32(work + i, in.split);
+}
+
+void binaryInsertionKernel(const kernel_input& in, int32_t* work, int32_t*) {
+    for (size_t i = 0; i + in.split <= in.keys.size(); i += in.split)
+        binaryInsertionSort(work, i, i + in.split, i);
+}
+
+void networkKernel(const kernel_input& in, int32_t* work, int32_t*) {
+    for (size_t i = 0; i + in.split <= in.keys.size(); i += in.split)
+        sort_int32_network(work + i, in.split);
+}
+
+void stdSortKernel(const kernel_input& in, int32_t* work, int32_t*) {
+    for (size_t i = 0; i + in.split <= in.keys.size(); i += in.split)
+        std::sort(work + i, work + i + in.split);
+}
+
+static const kernel kernels[] = {
+    { MERGE, "merge_scalar", mergeScalarKernel, false },
+    { MERGE, "merge_avx2", mergeAvx2Kernel, true },
+    { MERGE, "timsort_gallop", mergeGallopKernel, false },
+    { MERGE, "timsort_merge", mergeTimsortKernel, false },
+    { PARTITION, "partition", partitionKernel, false },
+    { PARTITION, "partitionBlock", partitionBlockKernel, false },
+    { PARTITION, "partition3Way", partition3WayKernel, false },
+    { PARTITION, "partitionChunk", partitionChunkKernel, false },
+    { SMALL_SORT, "insertion_sort", insertionSortKernel, false },
+    { SMALL_SORT, "binaryInsertionSort", binaryInsertionKernel, false },
+    { SMALL_SORT, "sort_int32_network", networkKernel, true },
+    { SMALL_SORT, "std_sort", stdSortKernel, false },
+};
+#define KERNELS (sizeof(kernels) / sizeof(kernels[0]))
+
+// Two sorted runs of total length n, the first n / (skew + 1) long
+void make_merge_input(kernel_input* in, size_t n, unsigned skew, unsigned seed) {
+    DATA_T* keys = create_array(n, WIDE_RANDOM, seed);
+    in->keys.assign(keys, keys + n);
+    free(keys);
+    in->split = std::max<size_t>(1, n / (skew + 1));
+    std::sort(in->keys.begin(), in->keys.begin() + in->split);
+    std::sort(in->keys.begin() + in->split, in->keys.end());
+}
+
+// Random keys with the key of the given rank (in percent) moved to the front
+void make_partition_input(kernel_input* in, size_t n, unsigned rankPercent, unsigned seed) {
+    DATA_T* keys = create_array(n, WIDE_RANDOM, seed);
+    in->keys.assign(keys, keys + n);
+    free(keys);
+    std::vector<int32_t> sorted(in->keys);
+    size_t rank = std::min(n - 1, n * rankPercent / 100);
+    std::nth_element(sorted.begin(), sorted.begin() + rank, sorted.end());
+    in->pivot = sorted[rank];
+    std::swap(in->keys[0], *std::find(in->keys.begin(), in->keys.end(), in->pivot));
+    in->split = 0;
+}
+
+// Random keys, sorted in independent groups of k
+void make_small_input(kernel_input* in, size_t n, unsigned k, unsigned seed) {
+    DATA_T* keys = create_array(n, WIDE_RANDOM, seed);
+    in->keys.assign(keys, keys + n);
+    free(keys);
+    in->split = k;
+}
+
+const char* cache_level(size_t bytes) {
+    if (bytes <= L1D_BYTES)
+        return "L1";
+    if (bytes <= L2_BYTES)
+        return "L2";
+    if (bytes <= L3_BYTES)
+        return "L3";
+    return "DRAM";
+}
+
+struct kernel_config {
+    std::vector<kernel_family> families;
+    std::vector<std::string> names;     // Empty: every kernel of the families
+    std::vector<uint64_t> sizes;
+    std::vector<unsigned> skews;
+    std::vector<unsigned> ranks;
+    std::vector<unsigned> smallSizes;
+    unsigned reps = 11;
+    unsigned seed = 1;
+    bool csv = false;
+};
+
+// Times reps runs of k (after one warmup) and prints one line
+void time_kernel(const kernel& k, const kernel_input& in, const char* param, unsigned reps, perf_counters* counters, bool csv) {
+    size_t const n = in.keys.size();
+    std::vector<int32_t> work(n), out(n);
+    std::vector<double> ns, cycles;
+    bool perfCycles = counters->fd[PERF_CYCLES] >= 0;
+
+    for (unsigned rep = 0; rep <= reps; rep++) {
+        struct timespec start, end;
+        perf_sample sample;
+        std::copy(in.keys.begin(), in.keys.end(), work.begin());
+
+        perf_counters_start(counters);
+        uint64_t tsc = __rdtsc();
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        k.run(in, work.data(), out.data());
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        tsc = __rdtsc() - tsc;
+        perf_counters_stop(counters, &sample);
+
+        if (rep == 0)
+            continue;   // Warmup
+        ns.push_back(((end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec)) / n);
+        cycles.push_back((perfCycles && sample.value[PERF_CYCLES] >= 0 ? sample.value[PERF_CYCLES] : tsc) / n);
+    }
+    std::sort(ns.begin(), ns.end());
+    std::sort(cycles.begin(), cycles.end());
+
+    // Working set: the keys, plus the output for the merges
+    size_t bytes = n * sizeof(int32_t) * (k.family == MERGE ? 2 : 1);
+    if (csv)
+        printf("%s,%s,%lu,%s,%s,%.4f,%.4f,%.3f\n", kernel_family_names[k.family], k.name, n, param, cache_level(bytes),
+               ns[0], ns[ns.size() / 2], cycles[cycles.size() / 2]);
+    else
+        printf("%-10s %-20s %9lu %-10s %-5s %9.3f %9.3f %9.3f\n", kernel_family_names[k.family], k.name, n, param, cache_level(bytes),
+               ns[0], ns[ns.size() / 2], cycles[cycles.size() / 2]);
+}
+
+void usage() {
+    printf("Usage: kernel_benchmark [options]\n"
+           "  --family f,...    merge, partition, small, or all (default all)\n"
+           "  --kernel k,...    only these kernels (default every kernel of the families)\n"
+           "  --size n,...      keys per run (default 4096,32768,524288,4194304: L1, L2, L3, DRAM)\n"
+           "  --skew s,...      merges: first run is 1/(s+1) of the keys (default 1,8,64)\n"
+           "  --rank r,...      partitions: pivot rank in percent (default 10,50,90)\n"
+           "  --small k,...     small sorts: keys per sort (default 8,16,32,64)\n"
+           "  --reps n          timed runs per kernel, after one warmup (default 11)\n"
+           "  --seed n          seed for the inputs (default 1)\n"
+           "  --format f        table or csv (default table)\n"
+           "Kernels:");
+    for (size_t k = 0; k < KERNELS; k++)
+        printf(" %s", kernels[k].name);
+    printf("\n");
+}
+
+std::vector<unsigned> parse_numbers(const char* list) {
+    std::vector<unsigned> values;
+    for (const char* c = list; *c;) {
+        values.push_back(strtoul(c, (char**)&c, 10));
+        if (*c == ',')
+            c++;
+        else if (*c)
+            return std::vector<unsigned>();
+    }
+    return values;
+}
+
+bool parse_args(int argc, char* argv[], kernel_config* config) {
+    for (int i = 1; i < argc; i++) {
+        const char* opt = argv[i];
+        if (strcmp(opt, "--help") == 0) {
+            usage();
+            exit(0);
+        }
+        if (i + 1 >= argc) {
+            fprintf(stderr, "Missing value for %s\n", opt);
+            return false;
+        }
+        const char* value = argv[++i];
+
+        std::vector<unsigned>* numbers = NULL;
+        if (strcmp(opt, "--family") == 0) {
+            std::string list = std::string(value) + ",";
+            for (size_t pos = 0, comma; (comma = list.find(',', pos)) != std::string::npos; pos = comma + 1) {
+                std::string name = list.substr(pos, comma - pos);
+                bool found = false;
+                for (int f = 0; f < 3; f++) {
+                    if (name == "all" || name == kernel_family_names[f]) {
+                        config->families.push_back((kernel_family)f);
+                        found = true;
+                    }
+                }
+                if (!found) {
+                    fprintf(stderr, "Unknown kernel family %s\n", name.c_str());
+                    return false;
+                }
+            }
+        } else if (strcmp(opt, "--kernel") == 0) {
+            std::string list = std::string(value) + ",";
+            for (size_t pos = 0, comma; (comma = list.find(',', pos)) != std::string::npos; pos = comma + 1)
+                config->names.push_back(list.substr(pos, comma - pos));
+        } else if (strcmp(opt, "--size") == 0) {
+            for (unsigned size : parse_numbers(value))
+                config->sizes.push_back(size);
+            if (config->sizes.empty()) {
+                fprintf(stderr, "Bad --size %s\n", value);
+                return false;
+            }
+        } else if (strcmp(opt, "--skew") == 0) {
+            numbers = &config->skews;
+        } else if (strcmp(opt, "--rank") == 0) {
+            numbers = &config->ranks;
+        } else if (strcmp(opt, "--small") == 0) {
+            numbers = &config->smallSizes;
+        } else if (strcmp(opt, "--reps") == 0) {
+            config->reps = atoi(value);
+            if (config->reps < 1) {
+                fprintf(stderr, "--reps must be at least 1\n");
+                return false;
+            }
+        } else if (strcmp(opt, "--seed") == 0) {
+            config->seed = atoi(value);
+        } else if (strcmp(opt, "--format") == 0) {
+            config->csv = strcmp(value, "csv") == 0;
+        } else {
+            fprintf(stderr, "Unknown option %s\n", opt);
+            return false;
+        }
+        if (numbers != NULL) {
+            *numbers = parse_numbers(value);
+            if (numbers->empty()) {
+                fprintf(stderr, "Bad %s %s\n", opt, value);
+                return false;
+            }
+        }
+    }
+
+    if (config->families.empty())
+        config->families = { MERGE, PARTITION, SMALL_SORT };
+    if (config->sizes.empty())
+        config->sizes = { 4096, 32768, 524288, 4194304 };
+    if (config->skews.empty())
+        config->skews = { 1, 8, 64 };
+    if (config->ranks.empty())
+        config->ranks = { 10, 50, 90 };
+    if (config->smallSizes.empty())
+        config->smallSizes = { 8, 16, 32, 64 };
+
+    for (unsigned k : config->smallSizes) {
+        if (k < 2 || k > SIMD_SORT_MAX) {
+            fprintf(stderr, "--small sizes must be 2..%d\n", SIMD_SORT_MAX);
+            return false;
+        }
+    }
+    for (unsigned r : config->ranks) {
+        if (r > 100) {
+            fprintf(stderr, "--rank is a percentage\n");
+            return false;
+        }
+    }
+    for (uint64_t size : config->sizes) {
+        if (size < 2 || size > INT32_MAX) {
+            fprintf(stderr, "--size must be 2..%d\n", INT32_MAX);
+            return false;
+        }
+    }
+    return true;
+}
+
+bool wanted(const kernel_config& config, const kernel& k) {
+    if (!config.names.empty() && std::find(config.names.begin(), config.names.end(), k.name) == config.names.end())
+        return false;
+    if (k.needsAvx2 && !__builtin_cpu_supports("avx2"))
+        return false;
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    kernel_config config;
+    if (!parse_args(argc, argv, &config)) {
+        usage();
+        return 1;
+    }
+
+    perf_counters counters;
+    perf_counters_open(&counters);
+    if (counters.fd[PERF_CYCLES] < 0)
+        fprintf(stderr, "Core cycle counter unavailable; cycles/elem are TSC reference cycles\n");
+
+    if (config.csv)
+        printf("family,kernel,size,param,cache,ns_per_elem_min,ns_per_elem_median,cycles_per_elem_median\n");
+    else
+        printf("%-10s %-20s %9s %-10s %-5s %9s %9s %9s\n", "family", "kernel", "size", "param", "cache", "ns/el min", "ns/el med", "cyc/el");
+
+    for (kernel_family family : config.families) {
+        for (uint64_t n : config.sizes) {
+            // The kernel's parameter: skew, pivot rank or keys per sort
+            const std::vector<unsigned>& params = family == MERGE ? config.skews : family == PARTITION ? config.ranks : config.smallSizes;
+            for (unsigned p : params) {
+                kernel_input in;
+                char param[32];
+                if (family == MERGE) {
+                    make_merge_input(&in, n, p, config.seed);
+                    snprintf(param, sizeof(param), "skew %u", p);
+                } else if (family == PARTITION) {
+                    make_partition_input(&in, n, p, config.seed);
+                    snprintf(param, sizeof(param), "rank %u%%", p);
+                } else {
+                    make_small_input(&in, n, p, config.seed);
+                    snprintf(param, sizeof(param), "k %u", p);
+                }
+                for (size_t k = 0; k < KERNELS; k++)
+                    if (kernels[k].family == family && wanted(config, kernels[k]))
+                        time_kernel(kernels[k], in, param, config.reps, &counters, config.csv);
+            }
+        }
+    }
+
+    perf_counters_close(&counters);
+    return 0;
+}
@@ -0,0 +1,204 @@
+// Binary key files, memory-mapped so the sorts work directly on the page
+// cache: no parsing, and no copy in or out. A file is a 64-byte header
+// followed by count native-endian keys of one fixed-width type; the header
+// size keeps the keys cache-line aligned.
+// Huge pages are used where the filesystem allows: hugetlbfs files are
+// mapped with them outright, anything else gets an MADV_HUGEPAGE hint,
+// which the kernel honours for tmpfs mounted with huge= (and ignores, or
+// refuses, elsewhere).
+#ifndef KEY_FILE_H
+#define KEY_FILE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/vfs.h>
+
+#define KEY_FILE_MAGIC "SORTKEYS"
+#define KEY_FILE_VERSION 1
+#define KEY_FILE_HEADER_BYTES 64
+#ifndef HUGETLBFS_MAGIC
+#define HUGETLBFS_MAGIC 0x958458f6
+#endif
+
+// Key types a file can hold; the values are part of the file format
+enum key_file_type { KEY_FILE_INT32 = 1, KEY_FILE_INT64 = 2, KEY_FILE_FLOAT = 3, KEY_FILE_DOUBLE = 4 };
+static const char* const key_file_type_names[] = { "", "int32", "int64", "float", "double" };
+static const size_t key_file_type_bytes[] = { 0, 4, 8, 4, 8 };
+#define KEY_FILE_TYPES 5
+
+struct key_file_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t type;          // key_file_type
+    uint64_t count;
+    uint8_t reserved[KEY_FILE_HEADER_BYTES - 24];
+};
+static_assert(sizeof(key_file_header) == KEY_FILE_HEADER_BYTES, "the header is 64 bytes on disk");
+
+// How the mapping ended up being backed
+enum key_file_pages { PAGES_NORMAL, PAGES_HUGETLBFS, PAGES_MADVISED };
+static const char* const key_file_pages_names[] = { "4 KiB", "hugetlbfs", "MADV_HUGEPAGE hint" };
+
+struct key_file {
+    int fd;
+    void* map;
+    size_t mapBytes;
+    key_file_header* header;
+    void* keys;             // header + 1
+    key_file_pages pages;
+};
+
+// Access patterns the sort phases tell the kernel about
+enum key_file_advice { ADVISE_LOAD, ADVISE_RANDOM, ADVISE_SEQUENTIAL, ADVISE_NORMAL };
+
+static inline size_t key_file_bytes(key_file_type type, uint64_t count) {
+    return KEY_FILE_HEADER_BYTES + count * key_file_type_bytes[type];
+}
+
+// Bytes to map for a key file of bytes bytes open on fd. Files on
+// hugetlbfs can only be a whole number of huge pages long, so there it's
+// rounded up; the keys past count are never looked at.
+static inline size_t key_file_map_bytes(int fd, size_t bytes) {
+    struct statfs fs;
+    if (fstatfs(fd, &fs) == 0 && (unsigned long)fs.f_type == HUGETLBFS_MAGIC && fs.f_bsize > 0)
+        return (bytes + fs.f_bsize - 1) / fs.f_bsize * fs.f_bsize;
+    return bytes;
+}
+
+// Maps the whole of kf->fd (mapBytes long) and settles on the page size
+static inline bool key_file_map(key_file* kf, const char* path, bool writable, bool hugePages) {
+    struct statfs fs;
+    bool const hugetlbfs = fstatfs(kf->fd, &fs) == 0 && (unsigned long)fs.f_type == HUGETLBFS_MAGIC;
+    kf->map = mmap(NULL, kf->mapBytes, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, kf->fd, 0);
+    if (kf->map == MAP_FAILED) {
+        perror(path);
+        return false;
+    }
+    kf->header = (key_file_header*)kf->map;
+    kf->keys = kf->header + 1;
+    kf->pages = PAGES_NORMAL;
+    if (hugetlbfs)
+        kf->pages = PAGES_HUGETLBFS;
+#ifdef MADV_HUGEPAGE
+    else if (hugePages && madvise(kf->map, kf->mapBytes, MADV_HUGEPAGE) == 0)
+        kf->pages = PAGES_MADVISED;
+#endif
+    return true;
+}
+
+// Maps an existing key file, read-write if writable (to sort it in place).
+// Prints why and returns false if it can't be opened or isn't a key file.
+static inline bool key_file_open(const char* path, bool writable, bool hugePages, key_file* kf) {
+    kf->fd = open(path, writable ? O_RDWR : O_RDONLY);
+    if (kf->fd < 0) {
+        perror(path);
+        return false;
+    }
+    struct stat st;
+    key_file_header header;
+    if (fstat(kf->fd, &st) != 0 || pread(kf->fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header) ||
+        memcmp(header.magic, KEY_FILE_MAGIC, 8) != 0 || header.version != KEY_FILE_VERSION ||
+        header.type == 0 || header.type >= KEY_FILE_TYPES ||
+        (uint64_t)st.st_size < key_file_bytes((key_file_type)header.type, header.count)) {
+        fprintf(stderr, "%s: not a version %d key file, or truncated\n", path, KEY_FILE_VERSION);
+        close(kf->fd);
+        return false;
+    }
+    kf->mapBytes = key_file_map_bytes(kf->fd, key_file_bytes((key_file_type)header.type, header.count));
+    if ((uint64_t)st.st_size < kf->mapBytes) {
+        fprintf(stderr, "%s: hugetlbfs file isn't a whole number of huge pages\n", path);
+        close(kf->fd);
+        return false;
+    }
+    if (!key_file_map(kf, path, writable, hugePages)) {
+        close(kf->fd);
+        return false;
+    }
+    return true;
+}
+
+// Creates (or replaces) path as a key file of count keys of type and maps
+// it read-write; the keys are left for the caller to fill in
+static inline bool key_file_create(const char* path, key_file_type type, uint64_t count, bool hugePages, key_file* kf) {
+    kf->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (kf->fd < 0) {
+        perror(path);
+        return false;
+    }
+    kf->mapBytes = key_file_map_bytes(kf->fd, key_file_bytes(type, count));
+    if (ftruncate(kf->fd, kf->mapBytes) != 0 || !key_file_map(kf, path, true, hugePages)) {
+        perror(path);
+        close(kf->fd);
+        return false;
+    }
+    memset(kf->header, 0, sizeof(key_file_header));
+    memcpy(kf->header->magic, KEY_FILE_MAGIC, 8);
+    kf->header->version = KEY_FILE_VERSION;
+    kf->header->type = type;
+    kf->header->count = count;
+    return true;
+}
+
+// Tells the kernel what the next phase will do with the keys:
+//   ADVISE_LOAD        read ahead everything, in order
+//   ADVISE_RANDOM      scattered access, so readahead would be wasted
+//   ADVISE_SEQUENTIAL  one pass in order; pages behind it can go early
+//   ADVISE_NORMAL      back to the kernel's default readahead
+static inline void key_file_advise(key_file* kf, key_file_advice advice) {
+    switch (advice) {
+    case ADVISE_LOAD:
+        madvise(kf->map, kf->mapBytes, MADV_SEQUENTIAL);
+        madvise(kf->map, kf->mapBytes, MADV_WILLNEED);
+        break;
+    case ADVISE_RANDOM:
+        madvise(kf->map, kf->mapBytes, MADV_RANDOM);
+        break;
+    case ADVISE_SEQUENTIAL:
+        madvise(kf->map, kf->mapBytes, MADV_SEQUENTIAL);
+        break;
+    case ADVISE_NORMAL:
+        madvise(kf->map, kf->mapBytes, MADV_NORMAL);
+        break;
+    }
+}
+
+// Bytes of the mapping currently backed by huge pages, from
+// /proc/self/smaps (0 if it can't be read). An accepted MADV_HUGEPAGE hint
+// is no promise, so this is what says whether huge pages were really used.
+static inline uint64_t key_file_huge_bytes(const key_file* kf) {
+    FILE* smaps = fopen("/proc/self/smaps", "r");
+    if (smaps == NULL)
+        return 0;
+    char line[256];
+    bool inMapping = false;
+    uint64_t kib = 0;
+    while (fgets(line, sizeof(line), smaps) != NULL) {
+        unsigned long lo, hi, value;
+        if (sscanf(line, "%lx-%lx ", &lo, &hi) == 2 && strchr(line, '-') < strchr(line, ' ')) {
+            inMapping = lo == (unsigned long)kf->map;
+        } else if (inMapping && (sscanf(line, "FilePmdMapped: %lu kB", &value) == 1 ||
+                                 sscanf(line, "ShmemPmdMapped: %lu kB", &value) == 1 ||
+                                 sscanf(line, "AnonHugePages: %lu kB", &value) == 1)) {
+            kib += value;
+        }
+    }
+    fclose(smaps);
+    // hugetlbfs pages don't show up in those fields; the whole file is huge,
+    // not counting the padding up to the last huge page
+    return kf->pages == PAGES_HUGETLBFS ? key_file_bytes((key_file_type)kf->header->type, kf->header->count) : kib << 10;
+}
+
+// Writes any changes back (if sync) and unmaps
+static inline bool key_file_close(key_file* kf, bool sync) {
+    bool ok = !sync || msync(kf->map, kf->mapBytes, MS_SYNC) == 0;
+    munmap(kf->map, kf->mapBytes);
+    close(kf->fd);
+    return ok;
+}
+
+#endif
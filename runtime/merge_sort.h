@@ -0,0 +1,125 @@
+// Top-down merge sort on 32-bit keys, sequential and on the shared thread
+// pool. Merges ping-pong between the input and one scratch buffer.
+#ifndef MERGE_SORT_H
+#define MERGE_SORT_H
+
+#include <stdint.h>
+#include <algorithm>
+#include "intro_sort.h"
+#include "scratch_arena.h"
+#include "simd_merge.h"
+#include "simd_sort_network.h"
+#include "thread_pool.h"
+#include "parallel_merge.h"
+#include "sort_tuning.h"
+
+// Merges two sorted subarrays of src[] into dst[left..right].
+// First subarray is src[left..mid]
+// Second subarray is src[mid+1..right]
+// The work is done by the AVX2 kernel in simd_merge.h, which falls back to
+// a scalar loop on CPUs without AVX2.
+static inline void merge(const int32_t* src, int32_t* dst, uint64_t const left, uint64_t const mid, uint64_t const right) {
+    merge_int32(src + left, mid - left + 1, src + mid + 1, right - mid, dst + left);
+}
+
+// Sorts src[begin..end] and leaves the result in dst[begin..end].
+// src and dst must hold the same values on entry; the two buffers swap roles
+// at every level, so each merge writes straight into its destination
+// instead of copying into temp arrays and back.
+template <uint64_t BaseCase>
+static inline void merge_sort_into_base(int32_t* src, int32_t* dst, uint64_t const begin, uint64_t const end) {
+    // Ranges of at most BaseCase keys are sorted in place in dst by a
+    // sorting network
+    if (end - begin < BaseCase) {
+        sort_int32_network(dst + begin, end - begin + 1);
+        return;
+    }
+
+    uint64_t mid = begin + (end - begin) / 2;
+    merge_sort_into_base<BaseCase>(dst, src, begin, mid);
+    merge_sort_into_base<BaseCase>(dst, src, mid + 1, end);
+    merge(src, dst, begin, mid, end);
+}
+
+typedef void (*merge_sort_into_fn)(int32_t*, int32_t*, uint64_t, uint64_t);
+
+// merge_sort_into_base for one of sort_tuning.h's tuning_base_cases
+static inline merge_sort_into_fn merge_sort_for_base_case(uint64_t baseCase) {
+    switch (baseCase) {
+    case 16: return merge_sort_into_base<16>;
+    case 24: return merge_sort_into_base<24>;
+    case 32: return merge_sort_into_base<32>;
+    case 48: return merge_sort_into_base<48>;
+    default: return merge_sort_into_base<64>;
+    }
+}
+
+// merge_sort_into_base with the machine's tuned base case, picked on the
+// first call
+static inline void merge_sort_into(int32_t* src, int32_t* dst, uint64_t const begin, uint64_t const end) {
+    static const merge_sort_into_fn tuned = merge_sort_for_base_case(sort_tuning_get().mergeSortBaseCase);
+    tuned(src, dst, begin, end);
+}
+
+// begin is for left index and end is right index
+// of the sub-array of arr to be sorted
+static inline void merge_sort(int32_t* array, uint64_t const begin, uint64_t const end) {
+    if (begin >= end)
+        return;
+
+    // One scratch buffer for the whole sort, seeded with a copy of the input.
+    // Without one, introSort sorts in place instead.
+    scratch_arena<int32_t> arena;
+    if (!arena_init(&arena, end - begin + 1)) {
+        introSort(array, begin, end);
+        return;
+    }
+    uint64_t const length = end - begin + 1;
+    for (uint64_t i = 0; i < length; i++)
+        arena.buffer[i] = array[begin + i];
+
+    merge_sort_into(arena.buffer, array + begin, 0, length - 1);
+    arena_free(&arena);
+}
+
+// merge() split across the shared pool: the output is cut into one piece
+// per thread at co-ranks, so the top levels of the sort don't serialise
+// on a single merge
+static inline void parallel_merge(const int32_t* src, int32_t* dst, uint64_t const left, uint64_t const mid, uint64_t const right) {
+    parallel_merge_int32(src + left, mid - left + 1, src + mid + 1, right - mid, dst + left, sort_pool->size());
+}
+
+// merge_sort_into with the two halves forked onto the shared pool.
+// Below the tuned grain the sequential version takes over.
+static inline void parallel_merge_sort_into(int32_t* src, int32_t* dst, uint64_t const begin, uint64_t const end) {
+    if (end - begin < sort_tuning_get().parallelMergeSortGrain) {
+        merge_sort_into(src, dst, begin, end);
+        return;
+    }
+
+    uint64_t mid = begin + (end - begin) / 2;
+    task_group group;
+    sort_pool->spawn(group, [=] { parallel_merge_sort_into(dst, src, begin, mid); });
+    parallel_merge_sort_into(dst, src, mid + 1, end);
+    sort_pool->wait(group);
+    parallel_merge(src, dst, begin, mid, end);
+}
+
+// Multithreaded merge_sort on the shared pool (see sort_pool_init)
+static inline void parallel_merge_sort(int32_t* array, uint64_t const begin, uint64_t const end) {
+    if (begin >= end)
+        return;
+
+    scratch_arena<int32_t> arena;
+    if (!arena_init(&arena, end - begin + 1)) {
+        introSort(array, begin, end);
+        return;
+    }
+    uint64_t const length = end - begin + 1;
+    std::copy(array + begin, array + end + 1, arena.buffer);
+
+    parallel_merge_sort_into(arena.buffer, array + begin, 0, length - 1);
+    arena_free(&arena);
+}
+
+#endif
@@ -0,0 +1,262 @@
+// Page-level control over the big buffers: the array being sorted and the
+// merge scratch. Buffers of at least PAGE_HUGE_BYTES can be backed by
+// transparent huge pages (madvise) or explicit hugetlbfs pages
+// (MAP_HUGETLB), and placed on NUMA nodes by first touch from sort_pool's
+// threads or by interleaving. The NUMA calls are the raw mbind and
+// move_pages syscalls, so there's no libnuma dependency.
+// With the default policy (small pages, default placement) everything comes
+// from malloc exactly as before. The policy must not change while buffers
+// allocated under another one are still live.
+#ifndef PAGE_ALLOC_H
+#define PAGE_ALLOC_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <vector>
+#include "thread_pool.h"
+
+#ifdef __linux__
+#include <linux/mempolicy.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+enum page_size_policy { PAGES_SMALL, PAGES_TRANSPARENT, PAGES_HUGETLB };
+static const char* const page_size_names[] = { "small", "thp", "hugetlb" };
+#define PAGE_SIZE_POLICIES 3
+
+enum page_numa_policy { NUMA_DEFAULT, NUMA_FIRST_TOUCH, NUMA_INTERLEAVE };
+static const char* const page_numa_names[] = { "default", "first_touch", "interleave" };
+#define PAGE_NUMA_POLICIES 3
+
+// Huge page size on x86-64; smaller buffers always come from malloc
+#define PAGE_HUGE_BYTES ((size_t)2 << 20)
+#define PAGE_SMALL_BYTES ((size_t)4096)
+// Nodes the placement report counts pages on
+#define PAGE_MAX_NODES 64
+// Pages move_pages is asked about per buffer, spread evenly over it
+#define PAGE_REPORT_SAMPLES 1024
+
+struct page_policy {
+    page_size_policy size;
+    page_numa_policy numa;
+};
+
+// Policy for every page_alloc; set it before allocating anything
+static page_policy page_alloc_policy = { PAGES_SMALL, NUMA_DEFAULT };
+
+// MAP_HUGETLB requests that found no free hugetlbfs pages and fell back to
+// transparent huge pages
+static std::atomic<uint64_t> page_hugetlb_fallbacks{0};
+
+// Where a buffer's pages ended up
+struct page_report {
+    uint64_t bytes;
+    uint64_t hugeBytes;             // Backed by huge pages (THP or hugetlbfs)
+    uint64_t sampled;               // Pages move_pages reported a node for
+    uint64_t nodePages[PAGE_MAX_NODES];
+};
+
+static inline bool page_mapped(size_t bytes) {
+    return bytes >= PAGE_HUGE_BYTES && (page_alloc_policy.size != PAGES_SMALL || page_alloc_policy.numa != NUMA_DEFAULT);
+}
+
+static inline size_t page_mapped_length(size_t bytes) {
+    return (bytes + PAGE_HUGE_BYTES - 1) & ~(PAGE_HUGE_BYTES - 1);
+}
+
+// Online NUMA nodes as a bit mask, from /sys/devices/system/node/online
+// ("0", "0-3", "0,2-3"); node 0 alone if it can't be read
+static inline uint64_t page_online_nodes() {
+    uint64_t mask = 0;
+    FILE* f = fopen("/sys/devices/system/node/online", "r");
+    if (f != NULL) {
+        unsigned first, last;
+        while (fscanf(f, "%u", &first) == 1) {
+            last = first;
+            int c = fgetc(f);
+            if (c == '-' && fscanf(f, "%u", &last) == 1)
+                c = fgetc(f);
+            for (unsigned node = first; node <= last && node < PAGE_MAX_NODES; node++)
+                mask |= (uint64_t)1 << node;
+            if (c != ',')
+                break;
+        }
+        fclose(f);
+    }
+    return mask ? mask : 1;
+}
+
+// Maps length bytes (a multiple of PAGE_HUGE_BYTES) at a huge-page-aligned
+// address, so transparent huge pages can back all of it
+static inline void* page_map_aligned(size_t length) {
+#ifdef __linux__
+    size_t const padded = length + PAGE_HUGE_BYTES;
+    char* p = (char*)mmap(NULL, padded, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED)
+        return NULL;
+    char* aligned = (char*)(((uintptr_t)p + PAGE_HUGE_BYTES - 1) & ~(uintptr_t)(PAGE_HUGE_BYTES - 1));
+    if (aligned > p)
+        munmap(p, aligned - p);
+    if (aligned + length < p + padded)
+        munmap(aligned + length, p + padded - (aligned + length));
+    return aligned;
+#else
+    (void)length;
+    return NULL;
+#endif
+}
+
+// Allocates bytes under page_alloc_policy; free with page_free(p, bytes).
+// Nothing is touched, so pages land wherever they're first written unless
+// the policy interleaves them. Returns NULL if memory runs out.
+static inline void* page_alloc(size_t bytes) {
+    if (!page_mapped(bytes))
+        return malloc(bytes ? bytes : 1);
+#ifdef __linux__
+    size_t const length = page_mapped_length(bytes);
+    void* p = NULL;
+    if (page_alloc_policy.size == PAGES_HUGETLB) {
+        p = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (p == MAP_FAILED) {
+            p = NULL;
+            page_hugetlb_fallbacks++;
+        }
+    }
+    if (p == NULL) {
+        p = page_map_aligned(length);
+        if (p == NULL)
+            return NULL;
+        if (page_alloc_policy.size != PAGES_SMALL)
+            madvise(p, length, MADV_HUGEPAGE);
+    }
+    if (page_alloc_policy.numa == NUMA_INTERLEAVE) {
+        unsigned long nodes = page_online_nodes();
+        syscall(SYS_mbind, p, length, MPOL_INTERLEAVE, &nodes, 8 * sizeof(nodes), 0);
+    }
+    return p;
+#else
+    return malloc(bytes);
+#endif
+}
+
+static inline void page_free(void* p, size_t bytes) {
+    if (p == NULL)
+        return;
+#ifdef __linux__
+    if (page_mapped(bytes)) {
+        munmap(p, page_mapped_length(bytes));
+        return;
+    }
+#endif
+    free(p);
+}
+
+static inline void page_touch(char* p, size_t bytes) {
+    for (size_t offset = 0; offset < bytes; offset += PAGE_SMALL_BYTES)
+        p[offset] = 0;
+}
+
+// page_alloc, with every page faulted in before it returns. Under
+// NUMA_FIRST_TOUCH the buffer is cut into one contiguous slice per
+// sort_pool thread and each thread touches its own, the way the parallel
+// sorts' top-level splits hand the array out, so each slice starts on the
+// node of a thread that sorts it. Otherwise the calling thread touches it.
+static inline void* page_alloc_populated(size_t bytes) {
+    char* p = (char*)page_alloc(bytes);
+    if (p == NULL)
+        return NULL;
+    unsigned const threads = sort_pool ? sort_pool->size() : 1;
+    if (page_alloc_policy.numa != NUMA_FIRST_TOUCH || threads < 2 || !page_mapped(bytes)) {
+        page_touch(p, bytes);
+        return p;
+    }
+    // A slice per thread, claimed by the thread with its index when that
+    // thread gets a task, otherwise by whichever thread is free
+    size_t const slice = (bytes / threads + PAGE_SMALL_BYTES - 1) & ~(PAGE_SMALL_BYTES - 1);
+    std::vector<std::atomic<bool>> claimed(threads);
+    for (unsigned t = 0; t < threads; t++)
+        claimed[t] = false;
+    task_group group;
+    for (unsigned t = 0; t < threads; t++) {
+        sort_pool->spawn(group, [&, p, slice, bytes, threads] {
+            unsigned s = thread_pool::current_thread();
+            if (s >= threads || claimed[s].exchange(true)) {
+                for (s = 0; s < threads && claimed[s].exchange(true); s++) {
+                }
+            }
+            size_t const start = std::min(bytes, s * slice);
+            if (s < threads)
+                page_touch(p + start, std::min(bytes - start, slice));
+        });
+    }
+    sort_pool->wait(group);
+    return p;
+}
+
+// Adds up the huge-page-backed bytes of the mappings overlapping
+// [begin, end) from /proc/self/smaps
+static inline uint64_t page_huge_bytes(uintptr_t begin, uintptr_t end) {
+    uint64_t huge = 0;
+    FILE* f = fopen("/proc/self/smaps", "r");
+    if (f == NULL)
+        return 0;
+    char line[256];
+    bool inside = false;
+    while (fgets(line, sizeof(line), f) != NULL) {
+        unsigned long start, stop, kb;
+        if (sscanf(line, "%lx-%lx ", &start, &stop) == 2) {
+            inside = start < end && stop > begin;
+        } else if (inside && (sscanf(line, "AnonHugePages: %lu kB", &kb) == 1 || sscanf(line, "Private_Hugetlb: %lu kB", &kb) == 1)) {
+            huge += (uint64_t)kb * 1024;
+        }
+    }
+    fclose(f);
+    return std::min<uint64_t>(huge, end - begin);
+}
+
+// Reports how p[0..bytes) is backed and which nodes its pages are on
+static inline void page_report_of(const void* p, size_t bytes, page_report* report) {
+    memset(report, 0, sizeof(*report));
+    report->bytes = bytes;
+#ifdef __linux__
+    uintptr_t const begin = (uintptr_t)p & ~(uintptr_t)(PAGE_SMALL_BYTES - 1);
+    uintptr_t const end = (uintptr_t)p + bytes;
+    report->hugeBytes = page_huge_bytes((uintptr_t)p, end);
+
+    size_t const pages = (end - begin + PAGE_SMALL_BYTES - 1) / PAGE_SMALL_BYTES;
+    size_t const samples = std::min<size_t>(pages, PAGE_REPORT_SAMPLES);
+    std::vector<void*> addresses(samples);
+    std::vector<int> status(samples);
+    for (size_t s = 0; s < samples; s++)
+        addresses[s] = (void*)(begin + (pages * s / samples) * PAGE_SMALL_BYTES);
+    // With no target nodes move_pages only reports where each page is
+    if (syscall(SYS_move_pages, 0, samples, addresses.data(), NULL, status.data(), 0) != 0)
+        return;
+    for (size_t s = 0; s < samples; s++) {
+        if (status[s] >= 0 && status[s] < PAGE_MAX_NODES) {
+            report->nodePages[status[s]]++;
+            report->sampled++;
+        }
+    }
+#else
+    (void)p;
+#endif
+}
+
+// Describes a report in a few words, like "thp/first_touch huge 100% n0 50% n1 50%"
+static inline void page_describe(const page_report* report, char* out, size_t size) {
+    int used = snprintf(out, size, "%s/%s huge %.0f%%", page_size_names[page_alloc_policy.size],
+                        page_numa_names[page_alloc_policy.numa], report->bytes ? 100.0 * report->hugeBytes / report->bytes : 0);
+    for (unsigned node = 0; node < PAGE_MAX_NODES && report->sampled > 0; node++) {
+        if (report->nodePages[node] > 0 && used >= 0 && (size_t)used < size)
+            used += snprintf(out + used, size - used, " n%u %.0f%%", node, 100.0 * report->nodePages[node] / report->sampled);
+    }
+}
+
+#endif
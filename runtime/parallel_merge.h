@@ -0,0 +1,53 @@
+// Merge-path splitting of one large merge across the shared thread pool,
+// used by parallel_merge_sort and parallelTimSort.
+#ifndef PARALLEL_MERGE_H
+#define PARALLEL_MERGE_H
+
+#include <stdint.h>
+#include <algorithm>
+#include "simd_merge.h"
+#include "thread_pool.h"
+
+// Smallest piece of output worth a task of its own
+#define PARALLEL_MERGE_GRAIN (1 << 15)
+
+// Returns how many of the first k elements of the merge of a[0..na) and
+// b[0..nb) come from a. Ties go to a, so cutting the output at co-ranks
+// (the merge path) gives independent pieces whose merges are still stable.
+static inline uint64_t co_rank(uint64_t k, const int32_t* a, uint64_t na, const int32_t* b, uint64_t nb) {
+    uint64_t lo = k > nb ? k - nb : 0;
+    uint64_t hi = std::min(k, na);
+    for (;;) {
+        uint64_t i = lo + (hi - lo) / 2;
+        uint64_t j = k - i;
+        if (i > 0 && j < nb && a[i - 1] > b[j])
+            hi = i - 1;     // took too many from a
+        else if (j > 0 && i < na && b[j - 1] >= a[i])
+            lo = i + 1;     // took too few from a
+        else
+            return i;
+    }
+}
+
+// Merges a[0..na) and b[0..nb) into out (which must not overlap them),
+// cut into at most maxPieces pieces that run as tasks on sort_pool
+static inline void parallel_merge_int32(const int32_t* a, uint64_t na, const int32_t* b, uint64_t nb, int32_t* out, unsigned maxPieces) {
+    uint64_t const n = na + nb;
+    uint64_t const pieces = std::min<uint64_t>(n / PARALLEL_MERGE_GRAIN, maxPieces);
+    if (pieces < 2) {
+        merge_int32(a, na, b, nb, out);
+        return;
+    }
+
+    task_group group;
+    for (uint64_t p = 0; p < pieces; p++) {
+        sort_pool->spawn(group, [=] {
+            uint64_t k0 = n * p / pieces, k1 = n * (p + 1) / pieces;
+            uint64_t i0 = co_rank(k0, a, na, b, nb), i1 = co_rank(k1, a, na, b, nb);
+            merge_int32(a + i0, i1 - i0, b + (k0 - i0), (k1 - i1) - (k0 - i0), out + k0);
+        });
+    }
+    sort_pool->wait(group);
+}
+
+#endif
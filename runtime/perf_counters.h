@@ -0,0 +1,156 @@
+// Hardware performance counters read with perf_event_open, so the benchmark
+// can count cycles, branches and cache traffic for the sort call alone
+// instead of wrapping the whole process in perf stat.
+// Each counter is opened on its own (not as a group), so the kernel can
+// multiplex them when there are fewer hardware counters than events; each
+// region's count is scaled by the time enabled / time running during that
+// region (the kernel never resets those times, so they're read at the start
+// and subtracted). Any counter the CPU,
+// kernel or perf_event_paranoid setting refuses is simply reported as
+// unavailable.
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+enum perf_counter_id {
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_BRANCHES,
+    PERF_BRANCH_MISSES,
+    PERF_L1D_LOADS,
+    PERF_L1D_MISSES,
+    PERF_LLC_LOADS,
+    PERF_LLC_MISSES,
+    PERF_DTLB_LOADS,
+    PERF_DTLB_MISSES,
+    PERF_COUNTERS
+};
+
+// Same names perf stat uses
+static const char* const perf_counter_names[PERF_COUNTERS] = {
+    "cycles", "instructions", "branches", "branch-misses",
+    "L1-dcache-loads", "L1-dcache-load-misses", "LLC-loads", "LLC-load-misses",
+    "dTLB-loads", "dTLB-load-misses"
+};
+
+// What a counter's read() returns with PERF_FORMAT_TOTAL_TIME_ENABLED and
+// PERF_FORMAT_TOTAL_TIME_RUNNING
+struct perf_reading {
+    uint64_t value;
+    uint64_t enabled;
+    uint64_t running;
+};
+
+struct perf_counters {
+    int fd[PERF_COUNTERS];
+    perf_reading start[PERF_COUNTERS];  // At the last perf_counters_start
+};
+
+// Counts from one measured region; -1 where a counter is unavailable
+struct perf_sample {
+    double value[PERF_COUNTERS];
+};
+
+#ifdef __linux__
+static inline int perf_counter_open(uint32_t type, uint64_t config) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.inherit = 1;           // Threads started afterwards are counted too
+    attr.exclude_kernel = 1;    // Allowed at perf_event_paranoid 2
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static inline uint64_t perf_cache_config(uint64_t cache, uint64_t result) {
+    return cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (result << 16);
+}
+#endif
+
+// Opens every counter for the calling thread and any thread it starts
+// later, so it must be called before sort_pool_init for the pool's
+// workers to be counted. Returns the number of counters available.
+static inline int perf_counters_open(perf_counters* pc) {
+    int opened = 0;
+    for (int c = 0; c < PERF_COUNTERS; c++)
+        pc->fd[c] = -1;
+#ifdef __linux__
+    pc->fd[PERF_CYCLES] = perf_counter_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+    pc->fd[PERF_INSTRUCTIONS] = perf_counter_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+    pc->fd[PERF_BRANCHES] = perf_counter_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_INSTRUCTIONS);
+    pc->fd[PERF_BRANCH_MISSES] = perf_counter_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+    pc->fd[PERF_L1D_LOADS] = perf_counter_open(PERF_TYPE_HW_CACHE, perf_cache_config(PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_RESULT_ACCESS));
+    pc->fd[PERF_L1D_MISSES] = perf_counter_open(PERF_TYPE_HW_CACHE, perf_cache_config(PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_RESULT_MISS));
+    pc->fd[PERF_LLC_LOADS] = perf_counter_open(PERF_TYPE_HW_CACHE, perf_cache_config(PERF_COUNT_HW_CACHE_LL, PERF_COUNT_HW_CACHE_RESULT_ACCESS));
+    pc->fd[PERF_LLC_MISSES] = perf_counter_open(PERF_TYPE_HW_CACHE, perf_cache_config(PERF_COUNT_HW_CACHE_LL, PERF_COUNT_HW_CACHE_RESULT_MISS));
+    pc->fd[PERF_DTLB_LOADS] = perf_counter_open(PERF_TYPE_HW_CACHE, perf_cache_config(PERF_COUNT_HW_CACHE_DTLB, PERF_COUNT_HW_CACHE_RESULT_ACCESS));
+    pc->fd[PERF_DTLB_MISSES] = perf_counter_open(PERF_TYPE_HW_CACHE, perf_cache_config(PERF_COUNT_HW_CACHE_DTLB, PERF_COUNT_HW_CACHE_RESULT_MISS));
+    for (int c = 0; c < PERF_COUNTERS; c++)
+        opened += pc->fd[c] >= 0;
+#endif
+    return opened;
+}
+
+// Notes where every available counter stands and starts them all
+static inline void perf_counters_start(perf_counters* pc) {
+#ifdef __linux__
+    for (int c = 0; c < PERF_COUNTERS; c++)
+        if (pc->fd[c] >= 0 && read(pc->fd[c], &pc->start[c], sizeof(perf_reading)) != sizeof(perf_reading))
+            pc->start[c] = perf_reading{ 0, 0, 0 };
+    for (int c = 0; c < PERF_COUNTERS; c++)
+        if (pc->fd[c] >= 0)
+            ioctl(pc->fd[c], PERF_EVENT_IOC_ENABLE, 0);
+#else
+    (void)pc;
+#endif
+}
+
+// Stops the counters and reads what they counted since perf_counters_start
+static inline void perf_counters_stop(perf_counters* pc, perf_sample* sample) {
+    for (int c = 0; c < PERF_COUNTERS; c++)
+        sample->value[c] = -1;
+#ifdef __linux__
+    for (int c = 0; c < PERF_COUNTERS; c++)
+        if (pc->fd[c] >= 0)
+            ioctl(pc->fd[c], PERF_EVENT_IOC_DISABLE, 0);
+    for (int c = 0; c < PERF_COUNTERS; c++) {
+        perf_reading end;
+        if (pc->fd[c] < 0 || read(pc->fd[c], &end, sizeof(end)) != sizeof(end))
+            continue;
+        uint64_t const value = end.value - pc->start[c].value;
+        uint64_t const enabled = end.enabled - pc->start[c].enabled;
+        uint64_t const running = end.running - pc->start[c].running;
+        // A counter that never got onto the PMU during the region counted
+        // nothing, and stays unavailable
+        if (running > 0)
+            sample->value[c] = (double)value * enabled / running;
+    }
+#else
+    (void)pc;
+#endif
+}
+
+static inline void perf_counters_close(perf_counters* pc) {
+#ifdef __linux__
+    for (int c = 0; c < PERF_COUNTERS; c++)
+        if (pc->fd[c] >= 0)
+            close(pc->fd[c]);
+#endif
+    for (int c = 0; c < PERF_COUNTERS; c++)
+        pc->fd[c] = -1;
+}
+
+#endif
@@ -0,0 +1,289 @@
+// Quicksort on 32-bit keys: the original Lomuto-style quickSort, the
+// branch-free BlockQuicksort variant, and introSort split across the
+// shared thread pool with parallel partitioning.
+#ifndef QUICK_SORT_H
+#define QUICK_SORT_H
+
+#include <stdint.h>
+#include <algorithm>
+#include <vector>
+#include "intro_sort.h"
+#include "thread_pool.h"
+
+static inline int partition(int32_t arr[], int start, int end) {
+    int32_t pivot = arr[start];
+    int count = 0;
+    for (int i = start + 1; i <= end; i++) {
+        if (arr[i] <= pivot)
+            count++;
+    }
+    int pivotIndex = start + count;
+    std::swap(arr[pivotIndex], arr[start]);
+    int i = start, j = end;
+    while (i < pivotIndex && j > pivotIndex) {
+        while (i < pivotIndex && arr[i] <= pivot) {
+            i++;
+        }
+        while (j > pivotIndex && arr[j] > pivot) {
+            j--;
+        }
+        if (i < pivotIndex && j > pivotIndex) {
+            std::swap(arr[i++], arr[j--]);
+        }
+    }
+    return pivotIndex;
+}
+
+static inline void quickSort(int32_t arr[], uint64_t start, uint64_t end) {
+    if (start >= end)
+        return;
+    uint64_t p = partition(arr, start, end);
+    if (p > start)
+        quickSort(arr, start, p - 1);
+    quickSort(arr, p + 1, end);
+}
+
+// Elements classified per block by partitionBlock; offsets fit in a byte
+#define BLOCK_SIZE 128
+
+// Number of elements of block[0..size-1] greater than pivot
+static inline int countGreater(const int32_t block[], int size, int32_t pivot) {
+    int count = 0;
+    for (int i = 0; i < size; i++)
+        count += (block[i] > pivot);
+    return count;
+}
+
+// Same contract as partition() (pivot arr[start], <= pivot to the left),
+// but in the BlockQuicksort style: comparison results are written into
+// offset buffers without branching, then misplaced pairs are swapped in bulk.
+// The only data-dependent branches left are once per block, not per element.
+static inline int partitionBlock(int32_t arr[], int start, int end) {
+    int32_t pivot = arr[start];
+    int64_t l = start + 1, r = end;  // arr[l..r] is still unclassified
+    unsigned char offsetsL[BLOCK_SIZE], offsetsR[BLOCK_SIZE];
+    int numL = 0, numR = 0, startL = 0, startR = 0;
+
+    while (r - l + 1 >= 2 * BLOCK_SIZE) {
+        // A block with nothing to move (typical in runs of equal keys) is
+        // skipped after a count the compiler can vectorize
+        if (numL == 0 && countGreater(arr + l, BLOCK_SIZE, pivot) == 0) {
+            l += BLOCK_SIZE;
+            continue;
+        }
+        if (numR == 0 && countGreater(arr + r - BLOCK_SIZE + 1, BLOCK_SIZE, pivot) == BLOCK_SIZE) {
+            r -= BLOCK_SIZE;
+            continue;
+        }
+
+        if (numL == 0) {
+            startL = 0;
+            for (int i = 0; i < BLOCK_SIZE; i++) {
+                offsetsL[numL] = i;
+                numL += (arr[l + i] > pivot);
+            }
+        }
+        if (numR == 0) {
+            startR = 0;
+            for (int i = 0; i < BLOCK_SIZE; i++) {
+                offsetsR[numR] = i;
+                numR += (arr[r - i] <= pivot);
+            }
+        }
+
+        int num = std::min(numL, numR);
+        for (int k = 0; k < num; k++)
+            std::swap(arr[l + offsetsL[startL + k]], arr[r - offsetsR[startR + k]]);
+        numL -= num;
+        numR -= num;
+        startL += num;
+        startR += num;
+        if (numL == 0)
+            l += BLOCK_SIZE;
+        if (numR == 0)
+            r -= BLOCK_SIZE;
+    }
+
+    // A block with leftover offsets still lies inside arr[l..r],
+    // so the remainder can simply be finished one element at a time
+    while (l <= r) {
+        if (arr[l] <= pivot)
+            l++;
+        else
+            std::swap(arr[l], arr[r--]);
+    }
+    int pivotIndex = l - 1;
+    std::swap(arr[start], arr[pivotIndex]);
+    return pivotIndex;
+}
+
+// quickSort with partitionBlock in place of partition
+static inline void quickSortBlock(int32_t arr[], uint64_t start, uint64_t end) {
+    if (start >= end)
+        return;
+    uint64_t p = partitionBlock(arr, start, end);
+    if (p > start)
+        quickSortBlock(arr, start, p - 1);
+    quickSortBlock(arr, p + 1, end);
+}
+
+// Ranges at or above this size are partitioned by all threads together
+#define PARALLEL_PARTITION_GRAIN (1 << 17)
+
+// Partitions arr[begin..end) so that keys < pivot (or <= pivot when
+// Inclusive) come first. Returns the index of the first key of the right side.
+template <bool Inclusive>
+static inline uint64_t partitionChunk(int32_t arr[], uint64_t begin, uint64_t end, int32_t pivot) {
+    uint64_t i = begin, j = end;
+    for (;;) {
+        while (i < j && (Inclusive ? arr[i] <= pivot : arr[i] < pivot))
+            i++;
+        while (i < j && !(Inclusive ? arr[j - 1] <= pivot : arr[j - 1] < pivot))
+            j--;
+        if (i >= j)
+            return i;
+        std::swap(arr[i++], arr[--j]);
+    }
+}
+
+// A run of misplaced elements left behind by the per-thread partitions
+struct misplaced_run {
+    uint64_t begin;
+    uint64_t length;
+    uint64_t offset;  // Position of begin within the concatenation of all runs
+};
+
+// Finds the run holding element m of the concatenation of runs, and m's
+// position inside it
+static inline void locateMisplaced(const std::vector<misplaced_run>& runs, uint64_t m, size_t* run, uint64_t* offset) {
+    size_t lo = 0, hi = runs.size() - 1;
+    while (lo < hi) {
+        size_t mid = (lo + hi + 1) / 2;
+        if (runs[mid].offset <= m)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+    *run = lo;
+    *offset = m - runs[lo].offset;
+}
+
+// Swaps elements [m0, m1) of the concatenation of wrongLeft with the same
+// elements of the concatenation of wrongRight
+static inline void swapMisplaced(int32_t arr[], const std::vector<misplaced_run>& wrongLeft, const std::vector<misplaced_run>& wrongRight, uint64_t m0, uint64_t m1) {
+    size_t ra, rb;
+    uint64_t oa, ob;
+    locateMisplaced(wrongLeft, m0, &ra, &oa);
+    locateMisplaced(wrongRight, m0, &rb, &ob);
+    for (uint64_t m = m0; m < m1; m++) {
+        std::swap(arr[wrongLeft[ra].begin + oa], arr[wrongRight[rb].begin + ob]);
+        if (++oa == wrongLeft[ra].length) {
+            ra++;
+            oa = 0;
+        }
+        if (++ob == wrongRight[rb].length) {
+            rb++;
+            ob = 0;
+        }
+    }
+}
+
+// partitionChunk run by every thread of the shared pool: each thread
+// partitions its own slice, then the elements that ended up on the wrong
+// side of the final split are swapped across in a parallel cleanup pass
+template <bool Inclusive>
+static inline uint64_t parallelPartition(int32_t arr[], uint64_t begin, uint64_t end, int32_t pivot) {
+    uint64_t const n = end - begin;
+    unsigned const slices = sort_pool->size();
+    std::vector<uint64_t> sliceBegin(slices + 1), sliceSplit(slices);
+    for (unsigned c = 0; c <= slices; c++)
+        sliceBegin[c] = begin + n * c / slices;
+
+    task_group group;
+    for (unsigned c = 0; c < slices; c++) {
+        sort_pool->spawn(group, [&, c] {
+            sliceSplit[c] = partitionChunk<Inclusive>(arr, sliceBegin[c], sliceBegin[c + 1], pivot);
+        });
+    }
+    sort_pool->wait(group);
+
+    uint64_t split = begin;
+    for (unsigned c = 0; c < slices; c++)
+        split += sliceSplit[c] - sliceBegin[c];
+
+    // Right-side keys below the split and left-side keys above it;
+    // there are always equally many of each
+    std::vector<misplaced_run> wrongRight, wrongLeft;
+    uint64_t misplacedRight = 0, misplacedLeft = 0;
+    for (unsigned c = 0; c < slices; c++) {
+        uint64_t b = sliceSplit[c], e = std::min(sliceBegin[c + 1], split);
+        if (b < e) {
+            wrongRight.push_back(misplaced_run{b, e - b, misplacedRight});
+            misplacedRight += e - b;
+        }
+        b = std::max(sliceBegin[c], split);
+        e = sliceSplit[c];
+        if (b < e) {
+            wrongLeft.push_back(misplaced_run{b, e - b, misplacedLeft});
+            misplacedLeft += e - b;
+        }
+    }
+
+    uint64_t const misplaced = misplacedLeft;
+    if (misplaced == 0)
+        return split;
+    for (unsigned p = 0; p < slices; p++) {
+        uint64_t m0 = misplaced * p / slices, m1 = misplaced * (p + 1) / slices;
+        if (m0 < m1)
+            sort_pool->spawn(group, [&, m0, m1] { swapMisplaced(arr, wrongLeft, wrongRight, m0, m1); });
+    }
+    sort_pool->wait(group);
+    return split;
+}
+
+// Partitions arr[begin..end) with all threads if it is large enough
+template <bool Inclusive>
+static inline uint64_t partitionRange(int32_t arr[], uint64_t begin, uint64_t end, int32_t pivot) {
+    if (end - begin >= PARALLEL_PARTITION_GRAIN && sort_pool->size() > 1)
+        return parallelPartition<Inclusive>(arr, begin, end, pivot);
+    return partitionChunk<Inclusive>(arr, begin, end, pivot);
+}
+
+// introSortLoop with both sides of each partition run as tasks. Ranges
+// below the tuned grain are left to the sequential introSort.
+static inline void parallelQuickSortRange(int32_t arr[], uint64_t start, uint64_t end, int depthLimit) {
+    while (end - start >= sort_tuning_get().parallelQuickSortGrain && depthLimit > 0) {
+        depthLimit--;
+        int32_t pivot = arr[choosePivot(arr, start, end)];
+
+        // Keys < pivot to the left. If there are none, the pivot is the
+        // minimum: split off every key equal to it instead, which is then
+        // already in place, so runs of equal keys can't stall the loop
+        uint64_t split = partitionRange<false>(arr, start, end + 1, pivot);
+        if (split == start) {
+            start = partitionRange<true>(arr, start, end + 1, pivot);
+            if (start > end)
+                return;
+            continue;
+        }
+
+        task_group group;
+        sort_pool->spawn(group, [=] { parallelQuickSortRange(arr, start, split - 1, depthLimit); });
+        parallelQuickSortRange(arr, split, end, depthLimit);
+        sort_pool->wait(group);
+        return;
+    }
+    introSortLoop(arr, start, end, depthLimit);
+}
+
+// Multithreaded introSort on the shared pool (see sort_pool_init)
+static inline void parallelQuickSort(int32_t arr[], uint64_t start, uint64_t end) {
+    if (start >= end)
+        return;
+    int depthLimit = 0;
+    for (uint64_t n = end - start + 1; n > 1; n >>= 1)
+        depthLimit += 2;
+    parallelQuickSortRange(arr, start, end, depthLimit);
+}
+
+#endif
@@ -0,0 +1,270 @@
+// Non-comparison sort engine for fixed-width integer keys.
+// One pass finds the key range (and a rough distinct-key count); narrow
+// ranges are then counting sorted, and anything wider goes to an LSD radix
+// sort with 8, 11 or 16-bit digits. Keys are sorted as their unsigned
+// offset from the minimum, which handles signed keys and also drops the
+// high digits every key shares.
+#ifndef RADIX_SORT_H
+#define RADIX_SORT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <type_traits>
+#include "scratch_arena.h"
+#include "sort_tuning.h"
+
+// Key ranges up to this size are always counting sorted
+#define COUNTING_SORT_MIN_RANGE (1 << 16)
+// ...and never above this size, however large the input
+#define COUNTING_SORT_MAX_RANGE (1 << 22)
+// Bytes each bucket collects before it is flushed to the output
+#define RADIX_WC_BYTES 64
+// Bits in the sketch used to estimate the distinct-key count
+#define DISTINCT_SKETCH_BITS (1 << 16)
+
+// What the last radix_sort call found and did, for the benchmark output
+struct radix_report {
+    const char* path;          // "counting" or "lsd radix"
+    uint64_t range;            // max - min + 1, saturated at UINT64_MAX
+    uint64_t distinct;         // Estimated number of distinct keys
+    unsigned digitBits;        // LSD radix only
+    unsigned passes;           // Scatter passes actually run
+};
+static radix_report radix_last_report;
+
+template <typename T>
+struct key_stats {
+    T min;
+    T max;
+    uint64_t distinct;
+};
+
+// One pass over a[0..n) for the min, the max and a linear-counting
+// estimate of the distinct-key count
+template <typename T>
+key_stats<T> scan_keys(const T* a, size_t n) {
+    static uint64_t sketch[DISTINCT_SKETCH_BITS / 64];
+    memset(sketch, 0, sizeof(sketch));
+
+    key_stats<T> stats;
+    stats.min = stats.max = a[0];
+    for (size_t i = 0; i < n; i++) {
+        stats.min = std::min(stats.min, a[i]);
+        stats.max = std::max(stats.max, a[i]);
+        uint64_t h = (uint64_t)a[i] * 0x9E3779B97F4A7C15ull;
+        uint64_t bit = h >> (64 - 16);
+        sketch[bit / 64] |= 1ull << (bit % 64);
+    }
+
+    unsigned zeros = 0;
+    for (size_t w = 0; w < DISTINCT_SKETCH_BITS / 64; w++)
+        zeros += 64 - __builtin_popcountll(sketch[w]);
+    // Linear counting: m * ln(m / zeros). Once the sketch fills up all
+    // it can say is "many", so report every key as distinct.
+    double m = DISTINCT_SKETCH_BITS;
+    stats.distinct = zeros ? std::min<uint64_t>((uint64_t)(m * __builtin_log(m / zeros) + 0.5), n) : n;
+    return stats;
+}
+
+// Counting sort of a[0..n) whose keys all lie in [min, min + range)
+template <typename T>
+void counting_sort(T* a, size_t n, T min, uint64_t range) {
+    typedef typename std::make_unsigned<T>::type U;
+    // Runs of equal keys (sorted input, duplicates) would make every
+    // increment wait on the previous one, so small ranges count into four
+    // interleaved tables and add them up afterwards
+    const unsigned tables = range <= COUNTING_SORT_MIN_RANGE ? 4 : 1;
+    size_t const countBytes = tables * range * sizeof(uint64_t);
+    uint64_t* counts = (uint64_t*)scratch_take(countBytes);
+    if (counts == NULL) {
+        std::sort(a, a + n);
+        return;
+    }
+    memset(counts, 0, countBytes);
+
+    size_t i = 0;
+    if (tables == 4) {
+        for (; i + 4 <= n; i += 4) {
+            counts[(U)((U)a[i] - (U)min)]++;
+            counts[range + (U)((U)a[i + 1] - (U)min)]++;
+            counts[2 * range + (U)((U)a[i + 2] - (U)min)]++;
+            counts[3 * range + (U)((U)a[i + 3] - (U)min)]++;
+        }
+        for (uint64_t k = 0; k < range; k++)
+            counts[k] += counts[range + k] + counts[2 * range + k] + counts[3 * range + k];
+    }
+    for (; i < n; i++)
+        counts[(U)((U)a[i] - (U)min)]++;
+    size_t out = 0;
+    for (uint64_t k = 0; k < range; k++) {
+        T key = (T)((U)min + (U)k);
+        for (uint64_t c = counts[k]; c > 0; c--)
+            a[out++] = key;
+    }
+    scratch_give_back(counts, countBytes);
+}
+
+// Moves every key of src[0..n) to dst at the slot given by its digit,
+// staging each bucket's keys in a cache-line buffer. A bucket's first flush
+// only fills up to the next line boundary of dst, so every later flush is
+// one aligned, whole-line write instead of scattered single keys. The
+// buffers are static, so only one thread may be scattering at a time.
+template <typename T>
+void radix_scatter(const T* src, T* dst, size_t n, T min, unsigned shift, unsigned digitBits, uint64_t* offsets) {
+    typedef typename std::make_unsigned<T>::type U;
+    const U mask = (U)((1ull << digitBits) - 1);
+    const size_t buckets = (size_t)1 << digitBits;
+
+    // 16-bit digits have too many buckets for the buffers to stay in cache
+    if (digitBits > 11) {
+        for (size_t i = 0; i < n; i++) {
+            U digit = (U)((U)((U)src[i] - (U)min) >> shift) & mask;
+            dst[offsets[digit]++] = src[i];
+        }
+        return;
+    }
+
+    const unsigned per_line = RADIX_WC_BYTES / sizeof(T);
+    alignas(RADIX_WC_BYTES) static T lines[(1 << 11) * (RADIX_WC_BYTES / sizeof(T))];
+    static unsigned fill[1 << 11];
+    // Keys of dst's line before the bucket's first slot, left unused in its
+    // staging line so the staged keys sit where they'll go in dst
+    auto skipped = [&](uint64_t offset) { return (unsigned)((uintptr_t)(dst + offset) % RADIX_WC_BYTES / sizeof(T)); };
+    for (size_t b = 0; b < buckets; b++)
+        fill[b] = skipped(offsets[b]);
+
+    for (size_t i = 0; i < n; i++) {
+        U digit = (U)((U)((U)src[i] - (U)min) >> shift) & mask;
+        T* line = lines + digit * per_line;
+        line[fill[digit]++] = src[i];
+        if (fill[digit] == per_line) {
+            unsigned const skip = skipped(offsets[digit]);
+            if (skip == 0)
+                memcpy(dst + offsets[digit], line, RADIX_WC_BYTES);
+            else
+                memcpy(dst + offsets[digit], line + skip, (per_line - skip) * sizeof(T));
+            offsets[digit] += per_line - skip;
+            fill[digit] = 0;
+        }
+    }
+    for (size_t b = 0; b < buckets; b++) {
+        unsigned const skip = skipped(offsets[b]);
+        memcpy(dst + offsets[b], lines + b * per_line + skip, (fill[b] - skip) * sizeof(T));
+        offsets[b] += fill[b] - skip;
+    }
+}
+
+// LSD radix sort of a[0..n) with keys in [min, max]. The histograms of
+// all digits are built in one read pass, and passes whose digit is the
+// same for every key are skipped.
+template <typename T>
+void radix_sort_lsd(T* a, size_t n, T min, T max, unsigned digitBits) {
+    typedef typename std::make_unsigned<T>::type U;
+    const U span = (U)((U)max - (U)min);
+    const unsigned bits = span ? 64 - __builtin_clzll((uint64_t)span) : 0;
+    const unsigned digits = (bits + digitBits - 1) / digitBits;
+    const size_t buckets = (size_t)1 << digitBits;
+    const U mask = (U)(buckets - 1);
+
+    radix_last_report.path = "lsd radix";
+    radix_last_report.digitBits = digitBits;
+    radix_last_report.passes = 0;
+    if (digits == 0)
+        return;
+
+    // The histograms are taken first, so a scratch reserve hands them back
+    // last (see scratch_arena.h)
+    size_t const countBytes = digits * buckets * sizeof(uint64_t);
+    uint64_t* counts = (uint64_t*)scratch_take(countBytes);
+    scratch_arena<T> arena;
+    if (counts == NULL || !arena_init(&arena, n)) {
+        scratch_give_back(counts, countBytes);
+        std::sort(a, a + n);
+        return;
+    }
+    memset(counts, 0, countBytes);
+
+    for (size_t i = 0; i < n; i++) {
+        U key = (U)((U)a[i] - (U)min);
+        for (unsigned d = 0; d < digits; d++)
+            counts[d * buckets + ((key >> (d * digitBits)) & mask)]++;
+    }
+
+    T* src = a;
+    T* dst = arena.buffer;
+    for (unsigned d = 0; d < digits; d++) {
+        uint64_t* offsets = counts + d * buckets;
+        // Every key has the same digit here: nothing would move
+        if (*std::max_element(offsets, offsets + buckets) == n)
+            continue;
+
+        uint64_t sum = 0;
+        for (size_t b = 0; b < buckets; b++) {
+            uint64_t c = offsets[b];
+            offsets[b] = sum;
+            sum += c;
+        }
+        radix_scatter(src, dst, n, min, d * digitBits, digitBits, offsets);
+        std::swap(src, dst);
+        radix_last_report.passes++;
+    }
+
+    if (src != a)
+        std::copy(src, src + n, a);
+    arena_free(&arena);
+    scratch_give_back(counts, countBytes);
+}
+
+// Picks the digit width that needs the fewest passes over keys spanning
+// bits bits, only using wider digits once n is large enough to pay for
+// their bigger histograms. 16-bit digits scatter without the line buffers,
+// so they need a much larger input before saving a pass is worth it. Both
+// sizes are tuned (see sort_tuning.h).
+static inline unsigned radix_digit_bits(size_t n, unsigned bits) {
+    const sort_tuning& tuning = sort_tuning_get();
+    unsigned digitBits = 8;
+    if (n >= tuning.radix11BitMin && (bits + 10) / 11 < (bits + 7) / 8)
+        digitBits = 11;
+    if (n >= tuning.radix16BitMin && (bits + 15) / 16 < (bits + digitBits - 1) / digitBits)
+        digitBits = 16;
+    return digitBits;
+}
+
+// Bytes of digit histograms radix_sort_lsd takes for n keys spanning bits
+// bits, with the digit width radix_digit_bits picks
+static inline size_t radix_histogram_bytes(size_t n, unsigned bits) {
+    unsigned const digitBits = radix_digit_bits(n, bits);
+    return (bits + digitBits - 1) / digitBits * ((size_t)1 << digitBits) * sizeof(uint64_t);
+}
+
+// Sorts a[0..n) of any fixed-width integer type. Not reentrant: scan_keys
+// and radix_scatter work in static buffers, so two threads mustn't sort at
+// once.
+template <typename T>
+void radix_sort(T* a, size_t n) {
+    typedef typename std::make_unsigned<T>::type U;
+    if (n < 2)
+        return;
+
+    key_stats<T> stats = scan_keys(a, n);
+    U span = (U)((U)stats.max - (U)stats.min);
+    radix_last_report.range = sizeof(U) == 8 && span == (U)-1 ? UINT64_MAX : (uint64_t)span + 1;
+    radix_last_report.distinct = stats.distinct;
+    radix_last_report.digitBits = 0;
+    radix_last_report.passes = 1;
+
+    uint64_t countingLimit = std::max<uint64_t>(COUNTING_SORT_MIN_RANGE, std::min<uint64_t>(n, COUNTING_SORT_MAX_RANGE));
+    if (radix_last_report.range <= countingLimit) {
+        radix_last_report.path = "counting";
+        counting_sort(a, n, stats.min, radix_last_report.range);
+        return;
+    }
+
+    unsigned bits = 64 - __builtin_clzll((uint64_t)span);
+    radix_sort_lsd(a, n, stats.min, stats.max, radix_digit_bits(n, bits));
+}
+
+#endif
@@ -0,0 +1,100 @@
+// Scratch memory for the merge-based sorts.
+// One buffer is allocated before sorting starts and every merge borrows from it,
+// so the merge path itself never calls malloc/new. Buffers come from
+// page_alloc, so large ones follow page_alloc_policy's huge pages and NUMA
+// placement, unless a caller has set aside a reserve for them.
+#ifndef SCRATCH_ARENA_H
+#define SCRATCH_ARENA_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <atomic>
+#include "page_alloc.h"
+
+// Number of scratch buffers requested from the allocator since the last reset.
+// A sort that keeps the merge path allocation-free bumps this exactly once
+// (once per task for the parallel sorts, hence the atomic).
+static std::atomic<uint64_t> scratch_allocations{0};
+
+// Bytes held in scratch buffers right now, and the most held at once since
+// scratch_peak_bytes was last reset: the extra memory a sort needs on top
+// of its input.
+static std::atomic<uint64_t> scratch_bytes{0};
+static std::atomic<uint64_t> scratch_peak_bytes{0};
+
+// A region a caller sets aside to keep a sort inside a memory budget
+// (external_sort's run phase). While one is set, scratch is carved from it,
+// the last buffer taken freed first, and a request that doesn't fit fails
+// instead of allocating, so the sort takes its in-place fallback. Only for
+// sequential sorts: nothing stops two threads carving at once.
+struct scratch_reserve {
+    char* base;
+    size_t bytes;
+    size_t used;
+};
+static scratch_reserve scratch_reserved = { NULL, 0, 0 };
+
+static inline void scratch_reserve_set(void* base, size_t bytes) { scratch_reserved = scratch_reserve{ (char*)base, bytes, 0 }; }
+static inline void scratch_reserve_clear() { scratch_reserved = scratch_reserve{ NULL, 0, 0 }; }
+
+// Takes bytes of scratch, from the reserve if one is set and from
+// page_alloc otherwise, and counts them in scratch_bytes. Returns NULL if
+// memory runs out.
+static inline void* scratch_take(size_t bytes) {
+    void* p = NULL;
+    if (scratch_reserved.base != NULL) {
+        // Buffers start on a cache line, like page_alloc's
+        uintptr_t const base = (uintptr_t)scratch_reserved.base;
+        size_t const start = ((base + scratch_reserved.used + 63) & ~(uintptr_t)63) - base;
+        if (start <= scratch_reserved.bytes && bytes <= scratch_reserved.bytes - start) {
+            p = scratch_reserved.base + start;
+            scratch_reserved.used = start + bytes;
+        }
+    } else {
+        p = page_alloc(bytes);
+    }
+    scratch_allocations++;
+    if (p == NULL)
+        return NULL;
+    uint64_t const held = scratch_bytes += bytes;
+    uint64_t peak = scratch_peak_bytes.load();
+    while (held > peak && !scratch_peak_bytes.compare_exchange_weak(peak, held)) {
+    }
+    return p;
+}
+
+// Gives back bytes taken at p by scratch_take
+static inline void scratch_give_back(void* p, size_t bytes) {
+    if (p == NULL)
+        return;
+    char* const c = (char*)p;
+    if (c >= scratch_reserved.base && c < scratch_reserved.base + scratch_reserved.bytes)
+        scratch_reserved.used = c - scratch_reserved.base;
+    else
+        page_free(p, bytes);
+    scratch_bytes -= bytes;
+}
+
+template <typename T>
+struct scratch_arena {
+    T* buffer;
+    size_t capacity;
+};
+
+// Allocates room for capacity elements. Returns false if memory runs out.
+template <typename T>
+bool arena_init(scratch_arena<T>* arena, size_t capacity) {
+    arena->buffer = (T*)scratch_take((capacity ? capacity : 1) * sizeof(T));
+    arena->capacity = arena->buffer ? capacity : 0;
+    return arena->buffer != NULL;
+}
+
+template <typename T>
+void arena_free(scratch_arena<T>* arena) {
+    if (arena->buffer != NULL)
+        scratch_give_back(arena->buffer, (arena->capacity ? arena->capacity : 1) * sizeof(T));
+    arena->buffer = NULL;
+    arena->capacity = 0;
+}
+
+#endif
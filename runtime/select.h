@@ -0,0 +1,186 @@
+// Selection on 32-bit keys, for when only part of the sorted order is
+// needed: one rank (select_nth), the smallest k in order
+// (partial_sort_top), or several ranks in one pass (select_ranks). Like
+// std::nth_element and std::partial_sort they reorder the array in place.
+// The partitions are partitionBlock and partition3Way from the quicksorts,
+// with introSort's ninther pivots.
+#ifndef SELECT_H
+#define SELECT_H
+
+#include <stdint.h>
+#include <algorithm>
+#include "intro_sort.h"
+#include "quick_sort.h"
+
+// Groups of this size supply the median-of-medians pivots
+#define SELECT_GROUP 5
+// partial_sort_top keeps a heap when k is at most this and n / k is at
+// least PARTIAL_SORT_HEAP_RATIO, so the heap stays in cache and few keys
+// get into it
+#define PARTIAL_SORT_HEAP_MAX (1 << 16)
+#define PARTIAL_SORT_HEAP_RATIO 256
+
+// Ranges at or below this size are finished by sorting them
+static inline uint64_t select_cutoff() {
+    return simd_sort_available() ? SIMD_SORT_MAX : INSERTION_CUTOFF;
+}
+
+// Number of partitions introselect gets before it falls back: 2*log2(n)
+static inline int select_depth_limit(uint64_t n) {
+    int depthLimit = 0;
+    for (; n > 1; n >>= 1)
+        depthLimit += 2;
+    return depthLimit;
+}
+
+// Partitions arr[start..end] around arr[pivotIndex]. On return
+// arr[start..*lt-1] <= pivot, arr[*lt..*gt] == pivot and
+// arr[*gt+1..end] >= pivot, so ranks *lt..*gt are final. partitionBlock is
+// used unless threeWay asks for keys equal to the pivot to be split off
+// (or the range is past partitionBlock's int indices).
+static inline void select_partition(int32_t arr[], uint64_t start, uint64_t end, uint64_t pivotIndex, bool threeWay,
+                                    uint64_t* lt, uint64_t* gt) {
+    if (threeWay || end > INT32_MAX) {
+        partition3Way(arr, start, end, pivotIndex, lt, gt);
+        return;
+    }
+    std::swap(arr[start], arr[pivotIndex]);
+    *lt = *gt = partitionBlock(arr, (int)start, (int)end);
+}
+
+// A kept side this lopsided usually means keys equal to the pivot piled up
+// on one side of partitionBlock; the next partition is 3-way to split them off
+static inline bool select_lopsided(uint64_t kept, uint64_t size) {
+    return kept > size - size / 8;
+}
+
+// Guaranteed linear-time selection of rank k in arr[start..end]: the pivot
+// is the median of the medians of groups of SELECT_GROUP, which always
+// leaves at least 3/10 of the range on each side
+static inline void select_linear(int32_t arr[], uint64_t start, uint64_t end, uint64_t k) {
+    while (end - start + 1 > select_cutoff()) {
+        // Each group's median goes to the front, behind the groups already done
+        uint64_t const groups = (end - start + 1) / SELECT_GROUP;
+        for (uint64_t g = 0; g < groups; g++) {
+            int32_t* group = arr + start + g * SELECT_GROUP;
+            insertion_sort_int32(group, SELECT_GROUP);
+            std::swap(arr[start + g], group[SELECT_GROUP / 2]);
+        }
+        uint64_t const mid = start + groups / 2;
+        select_linear(arr, start, start + groups - 1, mid);
+
+        uint64_t lt, gt;
+        partition3Way(arr, start, end, mid, &lt, &gt);
+        if (k < lt)
+            end = lt - 1;
+        else if (k > gt)
+            start = gt + 1;
+        else
+            return;
+    }
+    sort_int32_network(arr + start, end - start + 1);
+}
+
+// Introselect: moves the key of rank k (0-based) of a[0..n) to a[k], with
+// keys <= it before and keys >= it after. Falls back to select_linear
+// after 2*log2(n) partitions, so the worst case stays O(n).
+static inline void select_nth(int32_t* a, size_t n, size_t k) {
+    if (k >= n)
+        return;
+    uint64_t start = 0, end = n - 1;
+    int depthLimit = select_depth_limit(n);
+    bool threeWay = false;
+    while (end - start + 1 > select_cutoff()) {
+        if (depthLimit-- == 0) {
+            select_linear(a, start, end, k);
+            return;
+        }
+        uint64_t const size = end - start + 1;
+        uint64_t lt, gt;
+        select_partition(a, start, end, choosePivot(a, start, end), threeWay, &lt, &gt);
+        if (k < lt)
+            end = lt - 1;
+        else if (k > gt)
+            start = gt + 1;
+        else
+            return;
+        threeWay = select_lopsided(end - start + 1, size);
+    }
+    sort_int32_network(a + start, end - start + 1);
+}
+
+// Moves the k smallest keys of a[0..n) to a[0..k), in order. For small k
+// a max-heap of the k smallest so far is kept in a[0..k) while the rest is
+// scanned once; most keys only cost a compare with its top. Input that
+// keeps feeding the heap (descending keys, say) is handed over to
+// select_nth before the heap work passes what selection would have cost.
+static inline void partial_sort_top(int32_t* a, size_t n, size_t k) {
+    k = std::min(k, n);
+    if (k == 0)
+        return;
+    if (k <= PARTIAL_SORT_HEAP_MAX && k <= n / PARTIAL_SORT_HEAP_RATIO) {
+        for (uint64_t i = k / 2; i-- > 0;)
+            siftDown(a, 0, i, k);
+        uint64_t budget = n / 16, i = k;
+        for (; i < n && budget > 0; i++) {
+            if (a[i] < a[0]) {
+                std::swap(a[0], a[i]);
+                siftDown(a, 0, 0, k);
+                budget--;
+            }
+        }
+        if (i == n) {
+            for (uint64_t last = k - 1; last > 0; last--) {
+                std::swap(a[0], a[last]);
+                siftDown(a, 0, 0, last);
+            }
+            return;
+        }
+    }
+    select_nth(a, n, k - 1);
+    if (k > 1)
+        introSort(a, 0, k - 2);
+}
+
+// select_nth for every rank in ranks[0..count) (ascending) at once: after a
+// partition, each side recurses with only the ranks that fall inside it,
+// so the ranks share the partitions near the top
+static inline void select_ranks_range(int32_t arr[], uint64_t start, uint64_t end, const size_t* ranks, size_t count,
+                                      int depthLimit, bool threeWay) {
+    while (count > 0) {
+        if (end - start + 1 <= select_cutoff()) {
+            sort_int32_network(arr + start, end - start + 1);
+            return;
+        }
+        // Several ranks left to find after this many partitions: just sort
+        if (depthLimit-- == 0) {
+            introSort(arr, start, end);
+            return;
+        }
+        uint64_t const size = end - start + 1;
+        uint64_t lt, gt;
+        select_partition(arr, start, end, choosePivot(arr, start, end), threeWay, &lt, &gt);
+
+        // Ranks inside the pivot's run are done
+        const size_t* left = std::lower_bound(ranks, ranks + count, lt);
+        const size_t* right = std::upper_bound(left, ranks + count, gt);
+        if (left > ranks && lt > start)
+            select_ranks_range(arr, start, lt - 1, ranks, left - ranks, depthLimit, select_lopsided(lt - start, size));
+        if (right == ranks + count || gt >= end)
+            return;
+        threeWay = select_lopsided(end - gt, size);
+        count -= right - ranks;
+        ranks = right;
+        start = gt + 1;
+    }
+}
+
+// Moves the keys of each rank in ranks[0..count) (ascending, 0-based, < n)
+// of a[0..n) to their sorted positions, as select_nth would for each one
+static inline void select_ranks(int32_t* a, size_t n, const size_t* ranks, size_t count) {
+    if (n == 0 || count == 0)
+        return;
+    select_ranks_range(a, 0, n - 1, ranks, count, select_depth_limit(n), false);
+}
+
+#endif
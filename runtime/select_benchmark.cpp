@@ -0,0 +1,316 @@
+// g++ -Wall -Wpedantic -march=haswell -O3 -pthread select_benchmark.cpp -o select_benchmark
+// ./select_benchmark --task all --order all --size 10000000 --k 1000 --quantiles 1,25,50,75,99
+// Times the selection entry points of select.h against the standard
+// library's and against sorting everything, for each task:
+//   nth        the median (select_nth)
+//   top_k      the k smallest keys in order (partial_sort_top)
+//   quantiles  several percentiles in one pass (select_ranks)
+// Every result is checked against a sorted copy of the input.
+// Get modern behaviour out of time.h, per https://stackoverflow.com/a/40515669
+#define _POSIX_C_SOURCE 199309L
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "sort_inputs.h"
+#include "select.h"
+
+enum select_task { NTH, TOP_K, QUANTILES };
+static const char* const select_task_names[] = { "nth", "top_k", "quantiles" };
+#define SELECT_TASKS 3
+
+// What one task asks for: ranks[0] for nth, the first k for top_k, and
+// every rank in ranks (ascending) for quantiles
+struct select_job {
+    select_task task;
+    size_t k;
+    std::vector<size_t> ranks;
+};
+
+void selectNth(int32_t* a, size_t n, const select_job& job) { select_nth(a, n, job.ranks[0]); }
+void stdNthElement(int32_t* a, size_t n, const select_job& job) { std::nth_element(a, a + job.ranks[0], a + n); }
+void partialSortTop(int32_t* a, size_t n, const select_job& job) { partial_sort_top(a, n, job.k); }
+void stdPartialSort(int32_t* a, size_t n, const select_job& job) { std::partial_sort(a, a + job.k, a + n); }
+void selectRanks(int32_t* a, size_t n, const select_job& job) { select_ranks(a, n, job.ranks.data(), job.ranks.size()); }
+
+// One nth_element per rank, each on the keys above the previous rank
+void stdNthElementEach(int32_t* a, size_t n, const select_job& job) {
+    size_t begin = 0;
+    for (size_t rank : job.ranks) {
+        std::nth_element(a + begin, a + rank, a + n);
+        begin = rank + 1;
+    }
+}
+
+void introSortFull(int32_t* a, size_t n, const select_job&) { introSort(a, 0, n - 1); }
+void stdSortFull(int32_t* a, size_t n, const select_job&) { std::sort(a, a + n); }
+
+#define ANY_TASK -1
+
+struct select_algorithm {
+    const char* name;
+    int task;       // select_task, or ANY_TASK for the full sorts
+    void (*run)(int32_t* a, size_t n, const select_job& job);
+};
+
+// std_sort comes first: the other times are reported relative to it
+static const select_algorithm algorithms[] = {
+    { "std_sort", ANY_TASK, stdSortFull },
+    { "introSort", ANY_TASK, introSortFull },
+    { "select_nth", NTH, selectNth },
+    { "std_nth_element", NTH, stdNthElement },
+    { "partial_sort_top", TOP_K, partialSortTop },
+    { "std_partial_sort", TOP_K, stdPartialSort },
+    { "select_ranks", QUANTILES, selectRanks },
+    { "std_nth_element", QUANTILES, stdNthElementEach },
+};
+#define ALGORITHMS (sizeof(algorithms) / sizeof(algorithms[0]))
+
+struct select_config {
+    std::vector<select_task> tasks;
+    std::vector<std::string> names;     // Empty: all
+    std::vector<array_ordering> orders;
+    std::vector<uint64_t> sizes;
+    size_t k = 1000;
+    std::vector<unsigned> quantiles;    // Percent
+    unsigned reps = 5;
+    unsigned seed = 1;
+    bool csv = false;
+};
+
+// Checks that a holds what job asked for, by comparing with sorted
+bool check(const int32_t* a, const std::vector<int32_t>& sorted, const select_job& job) {
+    if (job.task == TOP_K)
+        return std::equal(a, a + job.k, sorted.begin());
+    for (size_t rank : job.ranks)
+        if (a[rank] != sorted[rank])
+            return false;
+    return true;
+}
+
+// Median wall time in seconds of reps runs of algo on fresh copies of
+// keys, or -1 if a run gets the answer wrong
+double time_select(const select_algorithm& algo, const std::vector<int32_t>& keys, const std::vector<int32_t>& sorted,
+                   const select_job& job, unsigned reps, double* best) {
+    std::vector<int32_t> work(keys.size());
+    std::vector<double> seconds;
+    for (unsigned rep = 0; rep <= reps; rep++) {
+        struct timespec start, end;
+        std::copy(keys.begin(), keys.end(), work.begin());
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        algo.run(work.data(), work.size(), job);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        if (!check(work.data(), sorted, job))
+            return -1;
+        if (rep > 0)    // The first run is a warmup
+            seconds.push_back((end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9);
+    }
+    std::sort(seconds.begin(), seconds.end());
+    *best = seconds[0];
+    return seconds[seconds.size() / 2];
+}
+
+void usage() {
+    printf("Usage: select_benchmark [options]\n"
+           "  --task t,...       nth, top_k, quantiles, or all (default all)\n"
+           "  --algo a,...       only these algorithms (default all of each task's)\n"
+           "  --order o,...      input orderings, or all (default all)\n"
+           "  --size n,...       keys per array (default 10000000)\n"
+           "  --k n              keys wanted by top_k (default 1000)\n"
+           "  --quantiles p,...  percentiles wanted by quantiles (default 1,10,25,50,75,90,99)\n"
+           "  --reps n           timed runs, after one warmup (default 5)\n"
+           "  --seed n           seed for the inputs (default 1)\n"
+           "  --format f         table or csv (default table)\n"
+           "Algorithms:");
+    for (size_t a = 0; a < ALGORITHMS; a++)
+        if (a == 0 || strcmp(algorithms[a].name, algorithms[a - 1].name) != 0)
+            printf(" %s", algorithms[a].name);
+    printf("\nOrderings:");
+    for (int o = 0; o < ARRAY_ORDERINGS; o++)
+        printf(" %s", array_ordering_names[o]);
+    printf("\n");
+}
+
+// Splits a comma-separated list
+std::vector<std::string> split_list(const char* value) {
+    std::vector<std::string> items;
+    std::string list = std::string(value) + ",";
+    for (size_t pos = 0, comma; (comma = list.find(',', pos)) != std::string::npos; pos = comma + 1)
+        items.push_back(list.substr(pos, comma - pos));
+    return items;
+}
+
+bool parse_args(int argc, char* argv[], select_config* config) {
+    for (int i = 1; i < argc; i++) {
+        const char* opt = argv[i];
+        if (strcmp(opt, "--help") == 0) {
+            usage();
+            exit(0);
+        }
+        if (i + 1 >= argc) {
+            fprintf(stderr, "Missing value for %s\n", opt);
+            return false;
+        }
+        const char* value = argv[++i];
+
+        if (strcmp(opt, "--task") == 0) {
+            for (const std::string& name : split_list(value)) {
+                bool found = false;
+                for (int t = 0; t < SELECT_TASKS; t++) {
+                    if (name == "all" || name == select_task_names[t]) {
+                        config->tasks.push_back((select_task)t);
+                        found = true;
+                    }
+                }
+                if (!found) {
+                    fprintf(stderr, "Unknown task %s\n", name.c_str());
+                    return false;
+                }
+            }
+        } else if (strcmp(opt, "--algo") == 0) {
+            config->names = split_list(value);
+        } else if (strcmp(opt, "--order") == 0) {
+            for (const std::string& name : split_list(value)) {
+                bool found = false;
+                for (int o = 0; o < ARRAY_ORDERINGS; o++) {
+                    if (name == "all" || name == array_ordering_names[o]) {
+                        config->orders.push_back((array_ordering)o);
+                        found = true;
+                    }
+                }
+                if (!found) {
+                    fprintf(stderr, "Unknown ordering %s\n", name.c_str());
+                    return false;
+                }
+            }
+        } else if (strcmp(opt, "--size") == 0) {
+            for (const std::string& size : split_list(value)) {
+                config->sizes.push_back(strtoull(size.c_str(), NULL, 10));
+                if (config->sizes.back() < 1) {
+                    fprintf(stderr, "Bad --size %s\n", value);
+                    return false;
+                }
+            }
+        } else if (strcmp(opt, "--k") == 0) {
+            config->k = strtoull(value, NULL, 10);
+        } else if (strcmp(opt, "--quantiles") == 0) {
+            for (const std::string& p : split_list(value)) {
+                config->quantiles.push_back(atoi(p.c_str()));
+                if (config->quantiles.back() > 100) {
+                    fprintf(stderr, "--quantiles are percentages\n");
+                    return false;
+                }
+            }
+        } else if (strcmp(opt, "--reps") == 0) {
+            config->reps = atoi(value);
+            if (config->reps < 1) {
+                fprintf(stderr, "--reps must be at least 1\n");
+                return false;
+            }
+        } else if (strcmp(opt, "--seed") == 0) {
+            config->seed = atoi(value);
+        } else if (strcmp(opt, "--format") == 0) {
+            config->csv = strcmp(value, "csv") == 0;
+        } else {
+            fprintf(stderr, "Unknown option %s\n", opt);
+            return false;
+        }
+    }
+
+    if (config->tasks.empty())
+        config->tasks = { NTH, TOP_K, QUANTILES };
+    if (config->orders.empty())
+        for (int o = 0; o < ARRAY_ORDERINGS; o++)
+            config->orders.push_back((array_ordering)o);
+    if (config->sizes.empty())
+        config->sizes = { 10000000 };
+    if (config->quantiles.empty())
+        config->quantiles = { 1, 10, 25, 50, 75, 90, 99 };
+    std::sort(config->quantiles.begin(), config->quantiles.end());
+    return true;
+}
+
+// The job for task on n keys, and its parameter as printed
+select_job make_job(select_task task, size_t n, const select_config& config, std::string* param) {
+    select_job job;
+    job.task = task;
+    job.k = std::min(config.k, n);
+    char text[32];
+    if (task == NTH) {
+        job.ranks = { n / 2 };
+        snprintf(text, sizeof(text), "rank %zu", n / 2);
+    } else if (task == TOP_K) {
+        snprintf(text, sizeof(text), "k %zu", job.k);
+    } else {
+        for (unsigned p : config.quantiles)
+            job.ranks.push_back(std::min(n - 1, (size_t)(p / 100.0 * (n - 1) + 0.5)));
+        snprintf(text, sizeof(text), "%zu ranks", job.ranks.size());
+    }
+    *param = text;
+    return job;
+}
+
+int main(int argc, char* argv[]) {
+    select_config config;
+    if (!parse_args(argc, argv, &config)) {
+        usage();
+        return 1;
+    }
+
+    if (config.csv)
+        printf("task,algorithm,ordering,size,param,min_ms,median_ms,speedup_vs_std_sort\n");
+    else
+        printf("%-10s %-18s %-17s %10s %-10s %10s %10s %8s\n", "task", "algorithm", "ordering", "size", "param", "min", "median",
+               "vs sort");
+
+    for (uint64_t n : config.sizes) {
+        for (array_ordering order : config.orders) {
+            DATA_T* source = create_array(n, order, config.seed);
+            if (source == NULL) {
+                fprintf(stderr, "Couldn't allocate %lu keys\n", n);
+                return 1;
+            }
+            std::vector<int32_t> keys(source, source + n), sorted(keys);
+            free(source);
+            std::sort(sorted.begin(), sorted.end());
+
+            for (select_task task : config.tasks) {
+                std::string param;
+                select_job job = make_job(task, n, config, &param);
+                double sortMedian = 0;
+                for (size_t a = 0; a < ALGORITHMS; a++) {
+                    const select_algorithm& algo = algorithms[a];
+                    if (algo.task != ANY_TASK && algo.task != task)
+                        continue;
+                    // std_sort is always timed, as the baseline
+                    bool const shown = config.names.empty() ||
+                                       std::find(config.names.begin(), config.names.end(), algo.name) != config.names.end();
+                    if (!shown && a != 0)
+                        continue;
+                    double best;
+                    double median = time_select(algo, keys, sorted, job, config.reps, &best);
+                    if (median < 0) {
+                        fprintf(stderr, "%s got %s wrong on %s input\n", algo.name, select_task_names[task], array_ordering_names[order]);
+                        return 1;
+                    }
+                    if (a == 0)
+                        sortMedian = median;
+                    if (!shown)
+                        continue;
+                    double const speedup = median > 0 ? sortMedian / median : 0;
+                    if (config.csv)
+                        printf("%s,%s,%s,%lu,%s,%.4f,%.4f,%.2f\n", select_task_names[task], algo.name, array_ordering_names[order], n,
+                               param.c_str(), best * 1000, median * 1000, speedup);
+                    else
+                        printf("%-10s %-18s %-17s %10lu %-10s %7.2f ms %7.2f ms %7.1fx\n", select_task_names[task], algo.name,
+                               array_ordering_names[order], n, param.c_str(), best * 1000, median * 1000, speedup);
+                }
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,204 @@
+// AVX2 merge kernel for 32-bit keys, shared by merge_sort and timSort.
+// Two sorted inputs are merged 8 elements at a time with a bitonic merge
+// network held in registers; whatever is left over is finished by a scalar
+// tail. The AVX2 code is compiled with a target attribute and only called
+// when the CPU reports AVX2, so the same header also works in builds
+// without -march=haswell.
+#ifndef SIMD_MERGE_H
+#define SIMD_MERGE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <immintrin.h>
+
+// Inputs shorter than one vector aren't worth the setup
+#define SIMD_MERGE_WIDTH 8
+
+// Set to false to time the scalar path on an AVX2 machine
+static bool simd_merge_enabled = true;
+
+// The CPU check runs once; every later call is a load of a static
+static inline bool simd_merge_available() {
+    static const bool available = __builtin_cpu_supports("avx2");
+    return available && simd_merge_enabled;
+}
+
+// Scalar 2-way merge of a[0..na) and b[0..nb) into out
+static inline void merge_int32_scalar(const int32_t* a, size_t na, const int32_t* b, size_t nb, int32_t* out) {
+    size_t i = 0, j = 0, k = 0;
+    while (i < na && j < nb) {
+        if (a[i] <= b[j])
+            out[k++] = a[i++];
+        else
+            out[k++] = b[j++];
+    }
+    while (i < na)
+        out[k++] = a[i++];
+    while (j < nb)
+        out[k++] = b[j++];
+}
+
+// Scalar 2-way merge from the top: writes out[0..na+nb) last element first
+static inline void merge_int32_scalar_backward(const int32_t* a, size_t na, const int32_t* b, size_t nb, int32_t* out) {
+    size_t i = na, j = nb, k = na + nb;
+    while (i > 0 && j > 0) {
+        if (b[j - 1] < a[i - 1])
+            out[--k] = a[--i];
+        else
+            out[--k] = b[--j];
+    }
+    while (i > 0)
+        out[--k] = a[--i];
+    while (j > 0)
+        out[--k] = b[--j];
+}
+
+// Sorts a bitonic vector ascending: compare-exchange at distance 4, 2, 1
+__attribute__((target("avx2")))
+static inline __m256i bitonic_clean_8(__m256i x) {
+    __m256i p = _mm256_permute2x128_si256(x, x, 0x01);
+    x = _mm256_blend_epi32(_mm256_min_epi32(x, p), _mm256_max_epi32(x, p), 0xF0);
+    p = _mm256_shuffle_epi32(x, _MM_SHUFFLE(1, 0, 3, 2));
+    x = _mm256_blend_epi32(_mm256_min_epi32(x, p), _mm256_max_epi32(x, p), 0xCC);
+    p = _mm256_shuffle_epi32(x, _MM_SHUFFLE(2, 3, 0, 1));
+    x = _mm256_blend_epi32(_mm256_min_epi32(x, p), _mm256_max_epi32(x, p), 0xAA);
+    return x;
+}
+
+// Merges two ascending vectors: *lo gets the 8 smallest, *hi the 8 largest,
+// both ascending
+__attribute__((target("avx2")))
+static inline void bitonic_merge_8x8(__m256i* lo, __m256i* hi) {
+    const __m256i reverse = _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0);
+    __m256i b = _mm256_permutevar8x32_epi32(*hi, reverse);
+    __m256i l = _mm256_min_epi32(*lo, b);
+    __m256i h = _mm256_max_epi32(*lo, b);
+    *lo = bitonic_clean_8(l);
+    *hi = bitonic_clean_8(h);
+}
+
+// Merges a[0..na) and b[0..nb) into out[0..na+nb).
+// out may overlap b if out + na == b (the layout of timSort's mergeLo):
+// the kernel never writes past the next unread element of b.
+__attribute__((target("avx2")))
+static inline void merge_int32_avx2(const int32_t* a, size_t na, const int32_t* b, size_t nb, int32_t* out) {
+    if (na < SIMD_MERGE_WIDTH || nb < SIMD_MERGE_WIDTH) {
+        merge_int32_scalar(a, na, b, nb, out);
+        return;
+    }
+
+    __m256i lo = _mm256_loadu_si256((const __m256i*)a);
+    __m256i hi = _mm256_loadu_si256((const __m256i*)b);
+    size_t ia = SIMD_MERGE_WIDTH, ib = SIMD_MERGE_WIDTH;
+    for (;;) {
+        bitonic_merge_8x8(&lo, &hi);
+        _mm256_storeu_si256((__m256i*)out, lo);
+        out += SIMD_MERGE_WIDTH;
+
+        // Refill from whichever input has the smaller head, while it still
+        // has a whole vector left
+        bool takeA = ib == nb || (ia < na && a[ia] <= b[ib]);
+        if (takeA && na - ia >= SIMD_MERGE_WIDTH) {
+            lo = _mm256_loadu_si256((const __m256i*)(a + ia));
+            ia += SIMD_MERGE_WIDTH;
+        } else if (!takeA && nb - ib >= SIMD_MERGE_WIDTH) {
+            lo = _mm256_loadu_si256((const __m256i*)(b + ib));
+            ib += SIMD_MERGE_WIDTH;
+        } else {
+            break;
+        }
+    }
+
+    // Scalar tail: the 8 carried elements plus the rest of a and b
+    int32_t carry[SIMD_MERGE_WIDTH];
+    _mm256_storeu_si256((__m256i*)carry, hi);
+    size_t ic = 0;
+    while (ic < SIMD_MERGE_WIDTH && ia < na && ib < nb) {
+        if (carry[ic] <= a[ia] && carry[ic] <= b[ib])
+            *out++ = carry[ic++];
+        else if (a[ia] <= b[ib])
+            *out++ = a[ia++];
+        else
+            *out++ = b[ib++];
+    }
+    if (ic == SIMD_MERGE_WIDTH) {
+        merge_int32_scalar(a + ia, na - ia, b + ib, nb - ib, out);
+    } else if (ia == na) {
+        merge_int32_scalar(carry + ic, SIMD_MERGE_WIDTH - ic, b + ib, nb - ib, out);
+    } else {
+        merge_int32_scalar(carry + ic, SIMD_MERGE_WIDTH - ic, a + ia, na - ia, out);
+    }
+}
+
+// Mirror image of merge_int32_avx2, emitting the largest 8 first.
+// out may overlap a if out == a (the layout of timSort's mergeHi):
+// the kernel never writes below the next unread element of a.
+__attribute__((target("avx2")))
+static inline void merge_int32_avx2_backward(const int32_t* a, size_t na, const int32_t* b, size_t nb, int32_t* out) {
+    if (na < SIMD_MERGE_WIDTH || nb < SIMD_MERGE_WIDTH) {
+        merge_int32_scalar_backward(a, na, b, nb, out);
+        return;
+    }
+
+    size_t ia = na - SIMD_MERGE_WIDTH, ib = nb - SIMD_MERGE_WIDTH;
+    __m256i lo = _mm256_loadu_si256((const __m256i*)(a + ia));
+    __m256i hi = _mm256_loadu_si256((const __m256i*)(b + ib));
+    int32_t* end = out + na + nb;
+    for (;;) {
+        bitonic_merge_8x8(&lo, &hi);
+        end -= SIMD_MERGE_WIDTH;
+        _mm256_storeu_si256((__m256i*)end, hi);
+
+        // Refill from whichever input has the larger tail
+        bool takeA = ib == 0 || (ia > 0 && b[ib - 1] < a[ia - 1]);
+        if (takeA && ia >= SIMD_MERGE_WIDTH) {
+            ia -= SIMD_MERGE_WIDTH;
+            hi = _mm256_loadu_si256((const __m256i*)(a + ia));
+        } else if (!takeA && ib >= SIMD_MERGE_WIDTH) {
+            ib -= SIMD_MERGE_WIDTH;
+            hi = _mm256_loadu_si256((const __m256i*)(b + ib));
+        } else {
+            break;
+        }
+    }
+
+    // Scalar tail: the 8 carried elements plus what is left below ia and ib
+    int32_t carry[SIMD_MERGE_WIDTH];
+    _mm256_storeu_si256((__m256i*)carry, lo);
+    size_t ic = SIMD_MERGE_WIDTH;
+    while (ic > 0 && ia > 0 && ib > 0) {
+        if (carry[ic - 1] >= a[ia - 1] && carry[ic - 1] >= b[ib - 1])
+            *--end = carry[--ic];
+        else if (b[ib - 1] < a[ia - 1])
+            *--end = a[--ia];
+        else
+            *--end = b[--ib];
+    }
+    if (ic == 0) {
+        merge_int32_scalar_backward(a, ia, b, ib, end - ia - ib);
+    } else if (ia == 0) {
+        merge_int32_scalar_backward(carry, ic, b, ib, end - ic - ib);
+    } else {
+        merge_int32_scalar_backward(a, ia, carry, ic, end - ic - ia);
+    }
+}
+
+// Merges sorted a[0..na) and b[0..nb) into out[0..na+nb), using AVX2
+// when the CPU has it. Aliasing rules are those of merge_int32_avx2.
+static inline void merge_int32(const int32_t* a, size_t na, const int32_t* b, size_t nb, int32_t* out) {
+    if (simd_merge_available())
+        merge_int32_avx2(a, na, b, nb, out);
+    else
+        merge_int32_scalar(a, na, b, nb, out);
+}
+
+// Same as merge_int32 but fills out from the top.
+// Aliasing rules are those of merge_int32_avx2_backward.
+static inline void merge_int32_backward(const int32_t* a, size_t na, const int32_t* b, size_t nb, int32_t* out) {
+    if (simd_merge_available())
+        merge_int32_avx2_backward(a, na, b, nb, out);
+    else
+        merge_int32_scalar_backward(a, na, b, nb, out);
+}
+
+#endif
@@ -0,0 +1,166 @@
+// AVX2 sorting networks for up to 64 32-bit keys, used as the small-array
+// base case by merge_sort, introSort and timSort.
+// The keys are loaded into 1, 2, 4 or 8 registers (the last one padded with
+// INT32_MAX), each register is sorted with an in-register bitonic network,
+// and the registers are then combined with bitonic merges. There are no
+// data-dependent branches, unlike insertion sort. Like simd_merge.h, the AVX2
+// code is only called when the CPU has it.
+#ifndef SIMD_SORT_NETWORK_H
+#define SIMD_SORT_NETWORK_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <immintrin.h>
+
+// Largest input sort_int32_network accepts
+#define SIMD_SORT_MAX 64
+
+// Set to false to time the scalar path on an AVX2 machine
+static bool simd_sort_enabled = true;
+
+static inline bool simd_sort_available() {
+    static const bool available = __builtin_cpu_supports("avx2");
+    return available && simd_sort_enabled;
+}
+
+// Compare-exchange every lane with the lane Dist away (Dist = 1, 2 or 4).
+// MaxMask has a bit set for each lane that keeps the larger value.
+template <int Dist, int MaxMask>
+__attribute__((target("avx2")))
+static inline __m256i network_step(__m256i x) {
+    __m256i p;
+    if (Dist == 4)
+        p = _mm256_permute2x128_si256(x, x, 0x01);
+    else if (Dist == 2)
+        p = _mm256_shuffle_epi32(x, _MM_SHUFFLE(1, 0, 3, 2));
+    else
+        p = _mm256_shuffle_epi32(x, _MM_SHUFFLE(2, 3, 0, 1));
+    return _mm256_blend_epi32(_mm256_min_epi32(x, p), _mm256_max_epi32(x, p), MaxMask);
+}
+
+// Sorts one register ascending with the 6-stage bitonic sorting network
+__attribute__((target("avx2")))
+static inline __m256i network_sort_8(__m256i x) {
+    x = network_step<1, 0x66>(x);  // pairs, alternating direction
+    x = network_step<2, 0x3C>(x);  // quads, alternating direction
+    x = network_step<1, 0x5A>(x);
+    x = network_step<4, 0xF0>(x);  // all 8 ascending
+    x = network_step<2, 0xCC>(x);
+    x = network_step<1, 0xAA>(x);
+    return x;
+}
+
+// Sorts N registers that together hold a bitonic sequence
+template <int N>
+__attribute__((target("avx2")))
+static inline void network_bitonic_clean(__m256i* v) {
+    for (int d = N / 2; d > 0; d /= 2) {
+        for (int i = 0; i < N; i++) {
+            if (!(i & d)) {
+                __m256i mn = _mm256_min_epi32(v[i], v[i + d]);
+                __m256i mx = _mm256_max_epi32(v[i], v[i + d]);
+                v[i] = mn;
+                v[i + d] = mx;
+            }
+        }
+    }
+    for (int i = 0; i < N; i++) {
+        v[i] = network_step<4, 0xF0>(v[i]);
+        v[i] = network_step<2, 0xCC>(v[i]);
+        v[i] = network_step<1, 0xAA>(v[i]);
+    }
+}
+
+// Merges the sorted halves v[0..N/2) and v[N/2..N) into one sorted sequence
+template <int N>
+__attribute__((target("avx2")))
+static inline void network_merge(__m256i* v) {
+    const __m256i reverse = _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0);
+    const int h = N / 2;
+
+    // Reversing the second half makes the whole sequence bitonic
+    for (int i = 0; i < h / 2; i++) {
+        __m256i t = v[h + i];
+        v[h + i] = v[N - 1 - i];
+        v[N - 1 - i] = t;
+    }
+    for (int i = h; i < N; i++)
+        v[i] = _mm256_permutevar8x32_epi32(v[i], reverse);
+
+    for (int i = 0; i < h; i++) {
+        __m256i mn = _mm256_min_epi32(v[i], v[h + i]);
+        __m256i mx = _mm256_max_epi32(v[i], v[h + i]);
+        v[i] = mn;
+        v[h + i] = mx;
+    }
+    network_bitonic_clean<h>(v);
+    network_bitonic_clean<h>(v + h);
+}
+
+// Sorts the contents of N registers: each register on its own, then
+// pairwise merges of doubling width
+template <int N>
+__attribute__((target("avx2")))
+static inline void network_sort_all(__m256i* v) {
+    if constexpr (N == 1) {
+        v[0] = network_sort_8(v[0]);
+    } else {
+        network_sort_all<N / 2>(v);
+        network_sort_all<N / 2>(v + N / 2);
+        network_merge<N>(v);
+    }
+}
+
+// Loads a[0..n) into N registers, sorts them, and stores them back.
+// Lanes past n are padded with INT32_MAX so they sort to the end and are
+// never stored.
+template <int N>
+__attribute__((target("avx2")))
+static inline void network_sort_regs(int32_t* a, size_t n) {
+    const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256i pad = _mm256_set1_epi32(INT32_MAX);
+    __m256i v[N], mask[N];
+
+    for (int r = 0; r < N; r++) {
+        long left = (long)n - 8 * r;
+        int count = left < 0 ? 0 : left > 8 ? 8 : (int)left;
+        mask[r] = _mm256_cmpgt_epi32(_mm256_set1_epi32(count), lanes);
+        v[r] = _mm256_blendv_epi8(pad, _mm256_maskload_epi32(a + 8 * r, mask[r]), mask[r]);
+    }
+    network_sort_all<N>(v);
+    for (int r = 0; r < N; r++)
+        _mm256_maskstore_epi32(a + 8 * r, mask[r], v[r]);
+}
+
+// Scalar fallback: straight insertion sort of a[0..n)
+static inline void insertion_sort_int32(int32_t* a, size_t n) {
+    for (size_t i = 1; i < n; i++) {
+        int32_t temp = a[i];
+        size_t j = i;
+        while (j > 0 && a[j - 1] > temp) {
+            a[j] = a[j - 1];
+            j--;
+        }
+        a[j] = temp;
+    }
+}
+
+// Sorts a[0..n) for n <= SIMD_SORT_MAX
+static inline void sort_int32_network(int32_t* a, size_t n) {
+    if (n < 2)
+        return;
+    if (!simd_sort_available()) {
+        insertion_sort_int32(a, n);
+        return;
+    }
+    if (n <= 8)
+        network_sort_regs<1>(a, n);
+    else if (n <= 16)
+        network_sort_regs<2>(a, n);
+    else if (n <= 32)
+        network_sort_regs<4>(a, n);
+    else
+        network_sort_regs<8>(a, n);
+}
+
+#endif
@@ -0,0 +1,245 @@
+// Benchmark inputs: the array orderings every sort is timed on.
+// Every key comes from a counter-based generator: key i of a stream is a
+// hash of (seed, stream, i), so an array is the same for a given seed on any
+// libc and any number of threads, and its blocks can be filled in parallel
+// on sort_pool. The sorted orderings are built directly from counts of the
+// random keys rather than by sorting them.
+#ifndef SORT_INPUTS_H
+#define SORT_INPUTS_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <math.h>
+#include <algorithm>
+#include <vector>
+#include "thread_pool.h"
+
+// Define the data type and its format specifier
+#define DATA_T int
+#define DATA_PRINTF "%d"
+static_assert(sizeof(DATA_T) == sizeof(int32_t), "the sorts work on 32-bit keys");
+
+// Enum for array ordering
+enum array_ordering { RANDOM, SORTED, REVERSE_SORTED, ALMOST_SORTED, PARTIALLY_SORTED, MANY_DUPLICATE_VALUES, WIDE_RANDOM,
+                      ZIPF, SAWTOOTH, ORGAN_PIPE, FEW_UNIQUE, MEDIAN3_KILLER };
+
+// Names of the orderings, as used on the benchmark command line
+static const char* const array_ordering_names[] = { "random", "sorted", "reverse", "almost_sorted", "partially_sorted", "many_duplicates",
+                                                    "wide_random", "zipf", "sawtooth", "organ_pipe", "few_unique", "median3_killer" };
+#define ARRAY_ORDERINGS 12
+
+// Keys are filled in blocks of this many, each by one thread
+#define INPUT_BLOCK ((size_t)1 << 16)
+// random and the orderings built from it draw from 256 values, -128..127
+#define NARROW_KEYS 256
+// Distinct keys of zipf, drawn with frequency proportional to 1/rank
+#define ZIPF_KEYS ((uint32_t)1 << 20)
+// Ascending runs in sawtooth
+#define SAWTOOTH_TEETH 16
+// Distinct keys in few_unique
+#define FEW_UNIQUE_KEYS 16
+// Largest swap distance of almost_sorted
+#define ALMOST_SORTED_LIMIT 10
+
+// Independent streams drawn from one seed
+enum input_stream { STREAM_KEYS, STREAM_SWAPS, STREAM_WIDE, STREAM_UNIQUE, STREAM_WIDE64 };
+
+// splitmix64's output function
+static inline uint64_t input_mix(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+// Key of one stream of a seed, for input_random
+static inline uint64_t input_stream_key(unsigned seed, input_stream stream) {
+    return input_mix(((uint64_t)seed << 8 | stream) * 0x9e3779b97f4a7c15ULL);
+}
+
+// Value i of the stream with the given key: splitmix64 jumped straight to
+// step i
+static inline uint64_t input_random(uint64_t key, uint64_t i) {
+    return input_mix(key + (i + 1) * 0x9e3779b97f4a7c15ULL);
+}
+
+static inline DATA_T input_narrow(uint64_t key, uint64_t i) {
+    return (DATA_T)(input_random(key, i) >> 56) - NARROW_KEYS / 2;
+}
+
+static inline DATA_T input_wide(uint64_t key, uint64_t i) {
+    return (DATA_T)(uint32_t)(input_random(key, i) >> 32);
+}
+
+// Full-width 64-bit key i of a seed, for the 64-bit key types
+static inline int64_t input_wide64(unsigned seed, uint64_t i) {
+    return (int64_t)input_random(input_stream_key(seed, STREAM_WIDE64), i);
+}
+
+// Pieces input_for splits length keys into: a few per sort_pool thread,
+// each a whole number of blocks
+static inline size_t input_pieces(size_t length) {
+    size_t const blocks = (length + INPUT_BLOCK - 1) / INPUT_BLOCK;
+    size_t const threads = sort_pool ? sort_pool->size() : 1;
+    return threads < 2 ? 1 : std::max<size_t>(1, std::min(blocks, threads * 4));
+}
+
+// Calls fn(piece, begin, end) for each of the input_pieces of [0, length),
+// on sort_pool's threads if there's a pool
+template <typename F>
+static inline void input_for(size_t length, F fn) {
+    size_t const pieces = input_pieces(length);
+    if (pieces == 1 || sort_pool == NULL) {
+        fn((size_t)0, (size_t)0, length);
+        return;
+    }
+    size_t const blocks = (length + INPUT_BLOCK - 1) / INPUT_BLOCK;
+    task_group group;
+    for (size_t p = 0; p < pieces; p++) {
+        size_t const begin = std::min(length, blocks * p / pieces * INPUT_BLOCK);
+        size_t const end = std::min(length, blocks * (p + 1) / pieces * INPUT_BLOCK);
+        sort_pool->spawn(group, [&fn, p, begin, end] { fn(p, begin, end); });
+    }
+    sort_pool->wait(group);
+}
+
+// Fills array[0..length) with the first length narrow keys of the stream in
+// sorted (or descending) order. They're counted, not sorted: the counts
+// place every value's run, and each piece writes its own part of the runs.
+static inline void fill_sorted_narrow(DATA_T* array, size_t length, uint64_t key, bool descending) {
+    size_t const pieces = input_pieces(length);
+    std::vector<uint64_t> counts(pieces * NARROW_KEYS, 0);
+    input_for(length, [&](size_t piece, size_t begin, size_t end) {
+        uint64_t* count = &counts[piece * NARROW_KEYS];
+        for (size_t i = begin; i < end; i++)
+            count[input_narrow(key, i) + NARROW_KEYS / 2]++;
+    });
+    // start[v] is the rank of the first key with value v - 128
+    uint64_t start[NARROW_KEYS + 1] = { 0 };
+    for (int v = 0; v < NARROW_KEYS; v++) {
+        uint64_t total = 0;
+        for (size_t p = 0; p < pieces; p++)
+            total += counts[p * NARROW_KEYS + v];
+        start[v + 1] = start[v] + total;
+    }
+    input_for(length, [&](size_t, size_t begin, size_t end) {
+        if (begin == end)
+            return;
+        uint64_t const first = descending ? length - 1 - begin : begin;
+        int v = (int)(std::upper_bound(start, start + NARROW_KEYS + 1, first) - start) - 1;
+        for (size_t i = begin; i < end; i++) {
+            uint64_t const rank = descending ? length - 1 - i : i;
+            if (descending) {
+                while (rank < start[v])
+                    v--;
+            } else {
+                while (rank >= start[v + 1])
+                    v++;
+            }
+            array[i] = (DATA_T)v - NARROW_KEYS / 2;
+        }
+    });
+}
+
+// Swaps every key with one up to ALMOST_SORTED_LIMIT - 1 places after it,
+// left to right within each block
+static inline void gently_shuffle_array(DATA_T* array, size_t length, uint64_t key) {
+    input_for(length, [&](size_t, size_t begin, size_t end) {
+        for (size_t b = begin; b < end; b += INPUT_BLOCK) {
+            size_t const blockEnd = std::min(end, b + INPUT_BLOCK);
+            for (size_t i = b; i + ALMOST_SORTED_LIMIT + 1 < blockEnd; i++)
+                std::swap(array[i], array[i + input_random(key, i) % ALMOST_SORTED_LIMIT]);
+        }
+    });
+}
+
+// Key i of the orderings that are a function of i alone
+static inline DATA_T input_key(array_ordering order, size_t length, size_t i, unsigned seed) {
+    switch (order) {
+    case MANY_DUPLICATE_VALUES:
+        // The first half all the same value
+        return input_narrow(input_stream_key(seed, STREAM_KEYS), i < length / 2 ? 0 : i);
+    case WIDE_RANDOM:
+        return input_wide(input_stream_key(seed, STREAM_WIDE), i);
+    case ZIPF: {
+        // Inverse of the continuous approximation of the Zipf CDF, then a
+        // bijective scramble so the hot keys aren't all small
+        double const u = (input_random(input_stream_key(seed, STREAM_KEYS), i) >> 11) * 0x1.0p-53;
+        uint32_t const rank = std::min(ZIPF_KEYS, (uint32_t)pow((double)ZIPF_KEYS + 1, u)) - 1;
+        return (DATA_T)(rank * 0x9e3779b1u);
+    }
+    case SAWTOOTH:
+        return (DATA_T)(i % (length / SAWTOOTH_TEETH + 1));
+    case ORGAN_PIPE:
+        return (DATA_T)(i < length / 2 ? i : length - 1 - i);
+    case FEW_UNIQUE:
+        return input_wide(input_stream_key(seed, STREAM_UNIQUE), input_random(input_stream_key(seed, STREAM_KEYS), i) % FEW_UNIQUE_KEYS);
+    case MEDIAN3_KILLER: {
+        // Musser's sequence: 1, k+1, 3, k+3, ... then 2, 4, ..., 2k. It
+        // targets the median-of-3 partition of Musser's introsort paper;
+        // introSort's pivots here aren't slowed down by it.
+        size_t const k = length / 2;
+        if (i >= k)
+            return (DATA_T)(2 * (i - k) + 2);
+        return (DATA_T)(i % 2 == 0 ? i + 1 : k + i);
+    }
+    default:
+        return input_narrow(input_stream_key(seed, STREAM_KEYS), i);
+    }
+}
+
+// Fills array[0..length) with input_key, with the ordering fixed at
+// compile time so the per-key switch folds away
+template <array_ordering order>
+static inline void fill_keys(DATA_T* array, size_t length, unsigned seed) {
+    input_for(length, [&](size_t, size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++)
+            array[i] = input_key(order, length, i, seed);
+    });
+}
+
+// Function to create the array based on the ordering. The same seed
+// always gives the same array.
+static inline DATA_T* create_array(size_t length, array_ordering order, unsigned seed) {
+    DATA_T* array = (DATA_T*)malloc(length * sizeof(DATA_T));
+    if (array == NULL) {
+        perror("Failed to allocate memory");
+        return NULL;
+    }
+
+    uint64_t const keys = input_stream_key(seed, STREAM_KEYS);
+    switch (order) {
+    case SORTED:
+        fill_sorted_narrow(array, length, keys, false);
+        break;
+    case ALMOST_SORTED:
+        fill_sorted_narrow(array, length, keys, false);
+        gently_shuffle_array(array, length, input_stream_key(seed, STREAM_SWAPS));
+        break;
+    case REVERSE_SORTED:
+        fill_sorted_narrow(array, length, keys, true);
+        break;
+    case PARTIALLY_SORTED:
+        // Sort only the first half
+        fill_sorted_narrow(array, length / 2, keys, false);
+        input_for(length - length / 2, [&](size_t, size_t begin, size_t end) {
+            for (size_t i = length / 2 + begin; i < length / 2 + end; i++)
+                array[i] = input_narrow(keys, i);
+        });
+        break;
+    case MANY_DUPLICATE_VALUES: fill_keys<MANY_DUPLICATE_VALUES>(array, length, seed); break;
+    case WIDE_RANDOM: fill_keys<WIDE_RANDOM>(array, length, seed); break;
+    case ZIPF: fill_keys<ZIPF>(array, length, seed); break;
+    case SAWTOOTH: fill_keys<SAWTOOTH>(array, length, seed); break;
+    case ORGAN_PIPE: fill_keys<ORGAN_PIPE>(array, length, seed); break;
+    case FEW_UNIQUE: fill_keys<FEW_UNIQUE>(array, length, seed); break;
+    case MEDIAN3_KILLER: fill_keys<MEDIAN3_KILLER>(array, length, seed); break;
+    default: fill_keys<RANDOM>(array, length, seed); break;
+    }
+
+    return array;
+}
+
+#endif
@@ -0,0 +1,202 @@
+// Per-machine thresholds for the 32-bit key sorts. The defaults are the
+// constants the sorts were written with; autotune.cpp measures better ones
+// on this machine and writes them to a profile, which sort_tuning_load
+// reads at startup. A program that doesn't call it gets the profile at
+// sort_tuning_default_path, if there is one, on its first sort.
+// The thresholds that shape inner loops (timSort's minimum run, the
+// introSort and merge_sort cutoffs) may only take the values listed here:
+// each sort is compiled once per value, and the first call picks the
+// instantiation for the loaded value, so no call tests a runtime threshold.
+#ifndef SORT_TUNING_H
+#define SORT_TUNING_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "simd_sort_network.h"
+
+#define RUN 32 // timSort: arrays shorter than this are sorted without merging
+#define INSERTION_CUTOFF 24 // introSort: ranges this short go to insertion sort without AVX2
+#define MERGE_SORT_BASE_CASE 64 // At most SIMD_SORT_MAX
+#define PARALLEL_MERGE_SORT_GRAIN (1 << 14) // Smaller ranges aren't forked
+#define PARALLEL_QUICK_SORT_GRAIN (1 << 14)
+#define PARALLEL_TIMSORT_GRAIN (1 << 16)
+// radix_sort switches from 8 to 11-bit digits from this many keys, and to
+// 16-bit digits from the second
+#define RADIX_11_BIT_MIN (1 << 16)
+#define RADIX_16_BIT_MIN (1 << 25)
+
+// The values the template-selected thresholds can take
+static const uint64_t tuning_runs[] = { 16, 24, 32, 48, 64 };
+static const uint64_t tuning_cutoffs[] = { 8, 16, 24, 32, 48, 64 };
+static const uint64_t tuning_base_cases[] = { 16, 24, 32, 48, 64 };
+
+struct sort_tuning {
+    uint64_t timsortRun;
+    uint64_t introSortCutoff;
+    uint64_t mergeSortBaseCase;
+    uint64_t parallelMergeSortGrain;
+    uint64_t parallelQuickSortGrain;
+    uint64_t parallelTimSortGrain;
+    uint64_t radix11BitMin;
+    uint64_t radix16BitMin;
+};
+
+// One line of the profile
+struct tuning_parameter {
+    const char* name;
+    uint64_t sort_tuning::*field;
+    const uint64_t* choices;    // NULL if any value >= 1 will do
+    size_t nchoices;
+};
+
+static const tuning_parameter tuning_parameters[] = {
+    { "timsort_run", &sort_tuning::timsortRun, tuning_runs, sizeof(tuning_runs) / sizeof(tuning_runs[0]) },
+    { "introsort_cutoff", &sort_tuning::introSortCutoff, tuning_cutoffs, sizeof(tuning_cutoffs) / sizeof(tuning_cutoffs[0]) },
+    { "merge_sort_base_case", &sort_tuning::mergeSortBaseCase, tuning_base_cases, sizeof(tuning_base_cases) / sizeof(tuning_base_cases[0]) },
+    { "parallel_merge_sort_grain", &sort_tuning::parallelMergeSortGrain, NULL, 0 },
+    { "parallel_quick_sort_grain", &sort_tuning::parallelQuickSortGrain, NULL, 0 },
+    { "parallel_timsort_grain", &sort_tuning::parallelTimSortGrain, NULL, 0 },
+    { "radix_11_bit_min", &sort_tuning::radix11BitMin, NULL, 0 },
+    { "radix_16_bit_min", &sort_tuning::radix16BitMin, NULL, 0 },
+};
+#define TUNING_PARAMETERS (sizeof(tuning_parameters) / sizeof(tuning_parameters[0]))
+
+static inline sort_tuning sort_tuning_defaults() {
+    // Also run from static initialisers, before libgcc's own cpu check
+    __builtin_cpu_init();
+    sort_tuning t;
+    t.timsortRun = RUN;
+    // A sorting network finishes larger ranges than insertion sort can
+    t.introSortCutoff = simd_sort_available() ? SIMD_SORT_MAX : INSERTION_CUTOFF;
+    t.mergeSortBaseCase = MERGE_SORT_BASE_CASE;
+    t.parallelMergeSortGrain = PARALLEL_MERGE_SORT_GRAIN;
+    t.parallelQuickSortGrain = PARALLEL_QUICK_SORT_GRAIN;
+    t.parallelTimSortGrain = PARALLEL_TIMSORT_GRAIN;
+    t.radix11BitMin = RADIX_11_BIT_MIN;
+    t.radix16BitMin = RADIX_16_BIT_MIN;
+    return t;
+}
+
+// The thresholds every sort uses
+static sort_tuning sort_tuning_active = sort_tuning_defaults();
+static bool sort_tuning_loaded = false;
+
+// The CPU's model name, which a profile must have been measured on
+static inline void tuning_cpu_model(char* out, size_t size) {
+    snprintf(out, size, "unknown");
+    FILE* f = fopen("/proc/cpuinfo", "r");
+    if (f == NULL)
+        return;
+    char line[256];
+    while (fgets(line, sizeof(line), f) != NULL) {
+        char* colon = strchr(line, ':');
+        if (strncmp(line, "model name", 10) == 0 && colon != NULL) {
+            snprintf(out, size, "%s", colon + 2);
+            out[strcspn(out, "\n")] = '\0';
+            break;
+        }
+    }
+    fclose(f);
+}
+
+// $SORT_TUNING_PROFILE, or sort_tuning.<hostname>.profile in the working
+// directory
+static inline void sort_tuning_default_path(char* out, size_t size) {
+    const char* env = getenv("SORT_TUNING_PROFILE");
+    if (env != NULL) {
+        snprintf(out, size, "%s", env);
+        return;
+    }
+    char host[128] = "localhost";
+    gethostname(host, sizeof(host) - 1);
+    snprintf(out, size, "sort_tuning.%s.profile", host);
+}
+
+// Writes t to path as "name value" lines after a cpu line. Returns false if
+// the file can't be written.
+static inline bool sort_tuning_save(const sort_tuning& t, const char* path) {
+    FILE* f = fopen(path, "w");
+    if (f == NULL) {
+        perror(path);
+        return false;
+    }
+    char cpu[128];
+    tuning_cpu_model(cpu, sizeof(cpu));
+    fprintf(f, "# Written by autotune; only used on the CPU below\ncpu %s\n", cpu);
+    for (size_t p = 0; p < TUNING_PARAMETERS; p++)
+        fprintf(f, "%s %lu\n", tuning_parameters[p].name, t.*tuning_parameters[p].field);
+    return fclose(f) == 0;
+}
+
+// Loads the profile at path (sort_tuning_default_path if NULL) into
+// sort_tuning_active. Call it before the first sort. A missing default
+// profile quietly leaves the defaults; a profile from another CPU, or with
+// a value no instantiation exists for, is reported and that part ignored.
+// Returns false if path was given and couldn't be read.
+static inline bool sort_tuning_load(const char* path) {
+    sort_tuning_loaded = true;
+    char defaultPath[256];
+    if (path == NULL) {
+        sort_tuning_default_path(defaultPath, sizeof(defaultPath));
+        path = defaultPath;
+    }
+    FILE* f = fopen(path, "r");
+    if (f == NULL)
+        return path == defaultPath;
+
+    char cpu[128], line[256];
+    tuning_cpu_model(cpu, sizeof(cpu));
+    sort_tuning t = sort_tuning_defaults();
+    bool sameCpu = false;
+    while (fgets(line, sizeof(line), f) != NULL) {
+        line[strcspn(line, "\n")] = '\0';
+        if (line[0] == '#' || line[0] == '\0')
+            continue;
+        if (strncmp(line, "cpu ", 4) == 0) {
+            sameCpu = strcmp(line + 4, cpu) == 0;
+            continue;
+        }
+        char name[64];
+        unsigned long value;
+        if (sscanf(line, "%63s %lu", name, &value) != 2 || value < 1) {
+            fprintf(stderr, "%s: bad line \"%s\"\n", path, line);
+            continue;
+        }
+        size_t p = 0;
+        while (p < TUNING_PARAMETERS && strcmp(name, tuning_parameters[p].name) != 0)
+            p++;
+        if (p == TUNING_PARAMETERS) {
+            fprintf(stderr, "%s: unknown parameter %s\n", path, name);
+            continue;
+        }
+        const tuning_parameter& param = tuning_parameters[p];
+        bool allowed = param.choices == NULL;
+        for (size_t c = 0; c < param.nchoices; c++)
+            allowed |= param.choices[c] == value;
+        if (!allowed) {
+            fprintf(stderr, "%s: %s can't be %lu\n", path, name, value);
+            continue;
+        }
+        t.*param.field = value;
+    }
+    fclose(f);
+    if (!sameCpu) {
+        fprintf(stderr, "%s was tuned on another CPU; using the defaults\n", path);
+        return true;
+    }
+    sort_tuning_active = t;
+    return true;
+}
+
+// sort_tuning_active, loading the default profile on the first call if
+// nothing was loaded yet
+static inline const sort_tuning& sort_tuning_get() {
+    static const bool loaded = sort_tuning_loaded || sort_tuning_load(NULL);
+    (void)loaded;
+    return sort_tuning_active;
+}
+
+#endif
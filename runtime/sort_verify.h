@@ -0,0 +1,201 @@
+// Checks a sort's output in one pass: that it's in order, and that it holds
+// the same keys as the input. The keys are compared with an order-independent
+// digest of the input taken before the sort: the count, and the sum and the
+// xor of a hash of every key, so a merge that drops or duplicates keys is
+// caught even when its output is in order. 32-bit keys
+// are compared and hashed 8 at a time with AVX2; large arrays are split over
+// sort_pool's threads.
+#ifndef SORT_VERIFY_H
+#define SORT_VERIFY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <immintrin.h>
+#include <algorithm>
+#include <vector>
+#include "simd_merge.h"
+#include "thread_pool.h"
+
+// Arrays shorter than this are checked by the calling thread alone
+#define VERIFY_PARALLEL_MIN ((size_t)1 << 20)
+
+struct verify_digest {
+    uint64_t count;
+    uint64_t sum;       // Sum of verify_hash of every key
+    uint64_t xors;      // Xor of verify_hash of every key
+};
+
+static inline bool operator==(const verify_digest& a, const verify_digest& b) {
+    return a.count == b.count && a.sum == b.sum && a.xors == b.xors;
+}
+
+static inline void verify_combine(verify_digest* into, const verify_digest& part) {
+    into->count += part.count;
+    into->sum += part.sum;
+    into->xors ^= part.xors;
+}
+
+enum verify_result { VERIFY_OK, VERIFY_UNSORTED, VERIFY_NOT_PERMUTATION };
+
+// How each result reads after "left ... input of n values"
+static const char* const verify_result_names[] = { "sorted", "unsorted", "with keys lost or duplicated" };
+
+// murmur3's 32-bit finaliser
+static inline uint32_t verify_fmix32(uint32_t x) {
+    x ^= x >> 16;
+    x *= 0x85ebca6bu;
+    x ^= x >> 13;
+    x *= 0xc2b2ae35u;
+    return x ^ (x >> 16);
+}
+
+// splitmix64's output function
+static inline uint64_t verify_fmix64(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+// Hash of a key. Keys are hashed by their bytes, which is what the sorts
+// move around; int32_t gets a 32-bit hash so AVX2 can compute it.
+template <typename T>
+static inline uint64_t verify_hash(const T& key) {
+    static_assert(sizeof(T) % sizeof(uint32_t) == 0, "keys are hashed 32 bits at a time");
+    uint32_t words[sizeof(T) / sizeof(uint32_t)];
+    memcpy(words, &key, sizeof(T));
+    uint64_t folded = 0;
+    for (size_t w = 0; w < sizeof(T) / sizeof(uint32_t); w++)
+        folded = verify_fmix64(folded + words[w]);
+    return folded;
+}
+template <>
+inline uint64_t verify_hash<int32_t>(const int32_t& key) { return verify_fmix32((uint32_t)key); }
+
+// Digests keys[0..n) and, if order is set, clears *sorted when a key is
+// smaller than the one before it
+template <typename T>
+static inline void verify_scan_scalar(const T* keys, size_t n, bool order, bool* sorted, verify_digest* digest) {
+    bool inOrder = true;
+    for (size_t i = 0; i < n; i++) {
+        uint64_t const h = verify_hash(keys[i]);
+        digest->sum += h;
+        digest->xors ^= h;
+        if (order && i > 0)
+            inOrder &= !(keys[i] < keys[i - 1]);
+    }
+    digest->count += n;
+    *sorted &= inOrder;
+}
+
+__attribute__((target("avx2")))
+static inline __m256i verify_fmix32_avx2(__m256i x) {
+    x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 16));
+    x = _mm256_mullo_epi32(x, _mm256_set1_epi32((int)0x85ebca6bu));
+    x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 13));
+    x = _mm256_mullo_epi32(x, _mm256_set1_epi32((int)0xc2b2ae35u));
+    return _mm256_xor_si256(x, _mm256_srli_epi32(x, 16));
+}
+
+// verify_scan_scalar for 32-bit keys, 8 at a time: each vector is compared
+// with the same keys shifted by one, and its hashes are summed into four
+// 64-bit lanes and xored into eight 32-bit ones
+__attribute__((target("avx2")))
+static inline void verify_scan_int32_avx2(const int32_t* keys, size_t n, bool order, bool* sorted, verify_digest* digest) {
+    __m256i descents = _mm256_setzero_si256();
+    __m256i sums = _mm256_setzero_si256();
+    __m256i xors = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 9 <= n; i += 8) {
+        __m256i const v = _mm256_loadu_si256((const __m256i*)(keys + i));
+        __m256i const next = _mm256_loadu_si256((const __m256i*)(keys + i + 1));
+        descents = _mm256_or_si256(descents, _mm256_cmpgt_epi32(v, next));
+        __m256i const h = verify_fmix32_avx2(v);
+        sums = _mm256_add_epi64(sums, _mm256_cvtepu32_epi64(_mm256_castsi256_si128(h)));
+        sums = _mm256_add_epi64(sums, _mm256_cvtepu32_epi64(_mm256_extracti128_si256(h, 1)));
+        xors = _mm256_xor_si256(xors, h);
+    }
+    uint64_t laneSums[4];
+    uint32_t laneXors[8];
+    _mm256_storeu_si256((__m256i*)laneSums, sums);
+    _mm256_storeu_si256((__m256i*)laneXors, xors);
+    for (int l = 0; l < 4; l++)
+        digest->sum += laneSums[l];
+    for (int l = 0; l < 8; l++)
+        digest->xors ^= laneXors[l];
+    digest->count += i;
+    if (order && !_mm256_testz_si256(descents, descents))
+        *sorted = false;
+    // The tail, from the last key the vectors compared
+    if (i < n) {
+        if (order && i > 0 && keys[i] < keys[i - 1])
+            *sorted = false;
+        verify_scan_scalar(keys + i, n - i, order, sorted, digest);
+    }
+}
+
+template <typename T>
+static inline void verify_scan(const T* keys, size_t n, bool order, bool* sorted, verify_digest* digest) {
+    verify_scan_scalar(keys, n, order, sorted, digest);
+}
+template <>
+inline void verify_scan<int32_t>(const int32_t* keys, size_t n, bool order, bool* sorted, verify_digest* digest) {
+    if (simd_merge_available())
+        verify_scan_int32_avx2(keys, n, order, sorted, digest);
+    else
+        verify_scan_scalar(keys, n, order, sorted, digest);
+}
+
+// verify_scan over keys[0..n), one contiguous piece per sort_pool thread
+// for large arrays. Each piece also compares its first key with the last of
+// the piece before.
+template <typename T>
+static inline void verify_scan_parallel(const T* keys, size_t n, bool order, bool* sorted, verify_digest* digest) {
+    *digest = verify_digest{ 0, 0, 0 };
+    *sorted = true;
+    unsigned const pieces = sort_pool && n >= VERIFY_PARALLEL_MIN ? sort_pool->size() : 1;
+    if (pieces < 2) {
+        verify_scan(keys, n, order, sorted, digest);
+        return;
+    }
+    std::vector<verify_digest> digests(pieces, verify_digest{ 0, 0, 0 });
+    std::vector<char> inOrder(pieces, 1);
+    task_group group;
+    for (unsigned p = 0; p < pieces; p++) {
+        sort_pool->spawn(group, [&, p] {
+            size_t const begin = n * p / pieces, end = n * (p + 1) / pieces;
+            bool pieceSorted = !(order && begin > 0 && keys[begin] < keys[begin - 1]);
+            verify_scan(keys + begin, end - begin, order, &pieceSorted, &digests[p]);
+            inOrder[p] = pieceSorted;
+        });
+    }
+    sort_pool->wait(group);
+    for (unsigned p = 0; p < pieces; p++) {
+        verify_combine(digest, digests[p]);
+        *sorted &= inOrder[p] != 0;
+    }
+}
+
+// Digest of the keys about to be sorted
+template <typename T>
+static inline verify_digest verify_fingerprint(const T* keys, size_t n) {
+    verify_digest digest;
+    bool sorted;
+    verify_scan_parallel(keys, n, false, &sorted, &digest);
+    return digest;
+}
+
+// Checks keys[0..n) is in order and has the digest input had before the sort
+template <typename T>
+static inline verify_result verify_sorted(const T* keys, size_t n, const verify_digest& input) {
+    verify_digest digest;
+    bool sorted;
+    verify_scan_parallel(keys, n, true, &sorted, &digest);
+    if (!sorted)
+        return VERIFY_UNSORTED;
+    return digest == input ? VERIFY_OK : VERIFY_NOT_PERMUTATION;
+}
+
+#endif
@@ -0,0 +1,100 @@
+// Incremental sorting for keys that arrive in batches. Each batch is
+// sorted on its own (adaptive_sort) and appended as a run to timSort's
+// pending-run stack, so batches are merged lazily under the same stack
+// invariants: a key takes part in O(log n) merges over its lifetime
+// instead of one full sort per batch. The merges are timsort.h's, which
+// gallop when a batch is small next to the runs already resident and use
+// the AVX2 kernel when they are balanced.
+//   sorted_ingest si;
+//   ingest_init(&si);
+//   ingest_batch(&si, batch, n);     // as often as batches arrive
+//   const int32_t* all = ingest_sorted(&si);    // si.size keys in order
+//   ingest_free(&si);
+#ifndef SORTED_INGEST_H
+#define SORTED_INGEST_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <algorithm>
+#include "scratch_arena.h"
+#include "timsort.h"
+#include "adaptive_sort.h"
+
+struct sorted_ingest {
+    int32_t* keys;          // keys[0..size): the pending runs, back to back
+    size_t size, capacity;
+    timsort_state ts;       // The run stack and merge scratch
+};
+
+static inline void ingest_init(sorted_ingest* si) {
+    si->keys = NULL;
+    si->size = si->capacity = 0;
+    si->ts.arr = NULL;
+    si->ts.tmp = scratch_arena<int32_t>{ NULL, 0 };
+    si->ts.minGallop = MIN_GALLOP;
+    si->ts.stackSize = 0;
+}
+
+static inline void ingest_free(sorted_ingest* si) {
+    free(si->keys);
+    arena_free(&si->ts.tmp);
+    ingest_init(si);
+}
+
+// Merge scratch for size keys: a merge copies out its shorter run, which
+// is at most half of everything
+static inline bool ingest_reserve_scratch(sorted_ingest* si, size_t size) {
+    if (si->ts.tmp.capacity >= size / 2)
+        return true;
+    size_t const capacity = std::max(size / 2, 2 * si->ts.tmp.capacity);
+    arena_free(&si->ts.tmp);
+    return arena_init(&si->ts.tmp, capacity);
+}
+
+// Sorts batch[0..n) into a new run after the resident keys and merges runs
+// as the stack invariants require. Returns false, leaving the resident
+// keys as they were, if memory runs out.
+static inline bool ingest_batch(sorted_ingest* si, const int32_t* batch, size_t n) {
+    if (n == 0)
+        return true;
+    if (!ingest_reserve_scratch(si, si->size + n))
+        return false;
+    if (si->size + n > si->capacity) {
+        size_t capacity = std::max(si->size + n, 2 * si->capacity);
+        int32_t* keys = (int32_t*)realloc(si->keys, capacity * sizeof(int32_t));
+        if (keys == NULL)
+            return false;
+        si->keys = keys;
+        si->capacity = capacity;
+    }
+    std::copy(batch, batch + n, si->keys + si->size);
+    adaptive_sort(si->keys + si->size, n);
+
+    timsort_state* ts = &si->ts;
+    ts->arr = si->keys;
+    // A batch that continues the last run just lengthens it
+    if (ts->stackSize > 0 && si->keys[si->size - 1] <= si->keys[si->size]) {
+        ts->runLen[ts->stackSize - 1] += n;
+    } else {
+        ts->runBase[ts->stackSize] = si->size;
+        ts->runLen[ts->stackSize] = n;
+        ts->stackSize++;
+    }
+    si->size += n;
+    mergeCollapse(ts);
+    return true;
+}
+
+// Number of runs still waiting to be merged
+static inline int ingest_pending_runs(const sorted_ingest* si) {
+    return si->ts.stackSize;
+}
+
+// Merges whatever is pending and returns the keys, si->size of them, in
+// order. They stay valid until the next ingest_batch.
+static inline const int32_t* ingest_sorted(sorted_ingest* si) {
+    mergeForceCollapse(&si->ts);
+    return si->keys;
+}
+
+#endif
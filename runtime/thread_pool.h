@@ -0,0 +1,148 @@
+// Work-stealing thread pool shared by the parallel sorts.
+// Each thread owns a deque: it pushes and pops its own tasks at the back
+// (newest first, which keeps the recursion depth-first and cache-warm) and
+// steals from the front of other threads' deques (oldest, i.e. largest,
+// subproblems first). The thread that calls wait() keeps running tasks
+// until its group is done, so nested fork-join never blocks a worker.
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Counts the tasks of one fork-join region that haven't finished yet
+struct task_group {
+    std::atomic<uint64_t> pending{0};
+};
+
+class thread_pool {
+public:
+    // The calling thread counts as one of the threads, so threads - 1
+    // workers are started
+    explicit thread_pool(unsigned threads) : nthreads(threads ? threads : 1), queues(nthreads) {
+        for (unsigned i = 1; i < nthreads; i++)
+            workers.emplace_back(&thread_pool::worker_loop, this, i);
+    }
+
+    ~thread_pool() {
+        {
+            std::lock_guard<std::mutex> lock(idle_lock);
+            stopping = true;
+        }
+        idle.notify_all();
+        for (std::thread& worker : workers)
+            worker.join();
+    }
+
+    unsigned size() const { return nthreads; }
+
+    // Index of the calling thread in the pool, 0 for the thread that
+    // created it (and any other thread outside the pool)
+    static unsigned current_thread() { return current_queue(); }
+
+    // Queues fn as part of group; it may run on any thread
+    void spawn(task_group& group, std::function<void()> fn) {
+        group.pending++;
+        worker_queue& queue = queues[current_queue()];
+        {
+            std::lock_guard<std::mutex> lock(queue.lock);
+            queue.tasks.push_back(task{std::move(fn), &group});
+        }
+        {
+            std::lock_guard<std::mutex> lock(idle_lock);
+            queued++;
+        }
+        idle.notify_one();
+    }
+
+    // Runs queued tasks (its own first, then stolen ones) until every task
+    // in group has finished
+    void wait(task_group& group) {
+        unsigned self = current_queue();
+        while (group.pending > 0) {
+            if (!try_run_one(self))
+                std::this_thread::yield();
+        }
+    }
+
+private:
+    struct task {
+        std::function<void()> fn;
+        task_group* group;
+    };
+
+    struct worker_queue {
+        std::mutex lock;
+        std::deque<task> tasks;
+    };
+
+    // Index of the deque owned by the calling thread; threads outside the
+    // pool share deque 0 with the thread that created it
+    static unsigned& current_queue() {
+        static thread_local unsigned index = 0;
+        return index;
+    }
+
+    bool try_run_one(unsigned self) {
+        task next;
+        bool found = false;
+        for (unsigned k = 0; k < nthreads && !found; k++) {
+            worker_queue& queue = queues[(self + k) % nthreads];
+            std::lock_guard<std::mutex> lock(queue.lock);
+            if (queue.tasks.empty())
+                continue;
+            if (k == 0) {
+                next = std::move(queue.tasks.back());
+                queue.tasks.pop_back();
+            } else {
+                next = std::move(queue.tasks.front());
+                queue.tasks.pop_front();
+            }
+            found = true;
+        }
+        if (!found)
+            return false;
+
+        queued--;
+        next.fn();
+        next.group->pending--;
+        return true;
+    }
+
+    void worker_loop(unsigned self) {
+        current_queue() = self;
+        for (;;) {
+            if (try_run_one(self))
+                continue;
+            std::unique_lock<std::mutex> lock(idle_lock);
+            idle.wait(lock, [this] { return stopping || queued > 0; });
+            if (stopping)
+                return;
+        }
+    }
+
+    unsigned nthreads;
+    std::vector<worker_queue> queues;
+    std::vector<std::thread> workers;
+    std::atomic<uint64_t> queued{0};
+    bool stopping = false;
+    std::mutex idle_lock;
+    std::condition_variable idle;
+};
+
+// Pool shared by every parallel sort in the program
+static thread_pool* sort_pool = NULL;
+
+// (Re)creates the shared pool with the given number of threads
+static inline void sort_pool_init(unsigned threads) {
+    delete sort_pool;
+    sort_pool = new thread_pool(threads);
+}
+
+#endif
@@ -0,0 +1,616 @@
+// Timsort on 32-bit keys, sequential and on the shared thread pool.
+// Also the run-merging path of adaptive_sort.h.
+#ifndef TIMSORT_H
+#define TIMSORT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <algorithm>
+#include <vector>
+#include "scratch_arena.h"
+#include "simd_merge.h"
+#include "simd_sort_network.h"
+#include "thread_pool.h"
+#include "parallel_merge.h"
+#include "sort_tuning.h"
+
+// Number of consecutive wins by one run before merge switches to galloping
+#define MIN_GALLOP 7
+// Enough run-stack slots for any n that fits in 64 bits
+#define MAX_RUNS 85
+// Merges more lopsided than this skip the SIMD kernel
+#define SIMD_MERGE_MAX_SKEW 8
+
+// This function sorts arr[lo..hi) with binary insertion,
+// given that arr[lo..start) is already sorted
+static inline void binaryInsertionSort(int32_t arr[], size_t lo, size_t hi, size_t start)
+{
+    if (start == lo)
+        start++;
+    for (; start < hi; start++) {
+        int32_t pivot = arr[start];
+        size_t left = lo, right = start;
+        // Insert after any equal keys to keep the sort stable
+        while (left < right) {
+            size_t mid = (left + right) >> 1;
+            if (pivot < arr[mid])
+                right = mid;
+            else
+                left = mid + 1;
+        }
+        std::copy_backward(arr + left, arr + start, arr + start + 1);
+        arr[left] = pivot;
+    }
+}
+
+// Returns the length of the run starting at arr[lo], reversing it in place
+// if it is strictly descending, so every run on the stack is ascending
+static inline size_t countRunAndMakeAscending(int32_t arr[], size_t lo, size_t hi)
+{
+    size_t runHi = lo + 1;
+    if (runHi == hi)
+        return 1;
+
+    if (arr[runHi++] < arr[lo]) {
+        while (runHi < hi && arr[runHi] < arr[runHi - 1])
+            runHi++;
+        std::reverse(arr + lo, arr + runHi);
+    } else {
+        while (runHi < hi && arr[runHi] >= arr[runHi - 1])
+            runHi++;
+    }
+    return runHi - lo;
+}
+
+// Picks a minimum run length in [Run/2, Run] so that n / minrun is
+// a power of two or slightly less, which keeps the final merges balanced
+template <size_t Run>
+static inline size_t minRunLength(size_t n)
+{
+    size_t r = 0;
+    while (n >= Run) {
+        r |= n & 1;
+        n >>= 1;
+    }
+    return n + r;
+}
+
+// Returns k such that a[k-1] < key <= a[k], searching outwards from a[hint]
+static inline size_t gallopLeft(int32_t key, const int32_t a[], size_t len, size_t hint)
+{
+    ptrdiff_t lastOfs = 0, ofs = 1;
+    if (key > a[hint]) {
+        ptrdiff_t maxOfs = len - hint;
+        while (ofs < maxOfs && key > a[hint + ofs]) {
+            lastOfs = ofs;
+            ofs = (ofs << 1) + 1;
+        }
+        if (ofs > maxOfs)
+            ofs = maxOfs;
+        lastOfs += hint;
+        ofs += hint;
+    } else {
+        ptrdiff_t maxOfs = hint + 1;
+        while (ofs < maxOfs && key <= a[hint - ofs]) {
+            lastOfs = ofs;
+            ofs = (ofs << 1) + 1;
+        }
+        if (ofs > maxOfs)
+            ofs = maxOfs;
+        ptrdiff_t tmp = lastOfs;
+        lastOfs = hint - ofs;
+        ofs = hint - tmp;
+    }
+
+    // Now a[lastOfs] < key <= a[ofs]; binary search the gap
+    lastOfs++;
+    while (lastOfs < ofs) {
+        ptrdiff_t m = lastOfs + ((ofs - lastOfs) >> 1);
+        if (key > a[m])
+            lastOfs = m + 1;
+        else
+            ofs = m;
+    }
+    return ofs;
+}
+
+// Returns k such that a[k-1] <= key < a[k], searching outwards from a[hint]
+static inline size_t gallopRight(int32_t key, const int32_t a[], size_t len, size_t hint)
+{
+    ptrdiff_t lastOfs = 0, ofs = 1;
+    if (key < a[hint]) {
+        ptrdiff_t maxOfs = hint + 1;
+        while (ofs < maxOfs && key < a[hint - ofs]) {
+            lastOfs = ofs;
+            ofs = (ofs << 1) + 1;
+        }
+        if (ofs > maxOfs)
+            ofs = maxOfs;
+        ptrdiff_t tmp = lastOfs;
+        lastOfs = hint - ofs;
+        ofs = hint - tmp;
+    } else {
+        ptrdiff_t maxOfs = len - hint;
+        while (ofs < maxOfs && key >= a[hint + ofs]) {
+            lastOfs = ofs;
+            ofs = (ofs << 1) + 1;
+        }
+        if (ofs > maxOfs)
+            ofs = maxOfs;
+        lastOfs += hint;
+        ofs += hint;
+    }
+
+    // Now a[lastOfs] <= key < a[ofs]; binary search the gap
+    lastOfs++;
+    while (lastOfs < ofs) {
+        ptrdiff_t m = lastOfs + ((ofs - lastOfs) >> 1);
+        if (key < a[m])
+            ofs = m;
+        else
+            lastOfs = m + 1;
+    }
+    return ofs;
+}
+
+// Pending runs and merge scratch for one timSort call
+struct timsort_state {
+    int32_t* arr;
+    scratch_arena<int32_t> tmp;
+    ptrdiff_t minGallop;
+    size_t runBase[MAX_RUNS];
+    size_t runLen[MAX_RUNS];
+    int stackSize;
+};
+
+// Merges the adjacent runs arr[base1..base1+len1) and arr[base2..base2+len2)
+// left to right, with the first (shorter) run copied out to scratch.
+// arr[base2] is known to belong first and the last element of the first run
+// is known to belong last, which merge() has already arranged.
+static inline void mergeLo(timsort_state* ts, size_t base1, size_t len1, size_t base2, size_t len2)
+{
+    int32_t* arr = ts->arr;
+    int32_t* tmp = ts->tmp.buffer;
+    std::copy(arr + base1, arr + base1 + len1, tmp);
+
+    size_t cursor1 = 0, cursor2 = base2, dest = base1;
+    arr[dest++] = arr[cursor2++];
+    if (--len2 == 0) {
+        std::copy(tmp + cursor1, tmp + cursor1 + len1, arr + dest);
+        return;
+    }
+    if (len1 == 1) {
+        std::copy(arr + cursor2, arr + cursor2 + len2, arr + dest);
+        arr[dest + len2] = tmp[cursor1];
+        return;
+    }
+
+    ptrdiff_t minGallop = ts->minGallop;
+    while (true) {
+        size_t count1 = 0, count2 = 0;
+
+        // One element at a time until one run keeps winning
+        do {
+            if (arr[cursor2] < tmp[cursor1]) {
+                arr[dest++] = arr[cursor2++];
+                count2++;
+                count1 = 0;
+                if (--len2 == 0)
+                    goto done;
+            } else {
+                arr[dest++] = tmp[cursor1++];
+                count1++;
+                count2 = 0;
+                if (--len1 == 1)
+                    goto done;
+            }
+        } while ((ptrdiff_t)(count1 | count2) < minGallop);
+
+        // Galloping: copy whole stretches found by exponential search
+        do {
+            count1 = gallopRight(arr[cursor2], tmp + cursor1, len1, 0);
+            if (count1 != 0) {
+                std::copy(tmp + cursor1, tmp + cursor1 + count1, arr + dest);
+                dest += count1;
+                cursor1 += count1;
+                len1 -= count1;
+                if (len1 <= 1)
+                    goto done;
+            }
+            arr[dest++] = arr[cursor2++];
+            if (--len2 == 0)
+                goto done;
+
+            count2 = gallopLeft(tmp[cursor1], arr + cursor2, len2, 0);
+            if (count2 != 0) {
+                std::copy(arr + cursor2, arr + cursor2 + count2, arr + dest);
+                dest += count2;
+                cursor2 += count2;
+                len2 -= count2;
+                if (len2 == 0)
+                    goto done;
+            }
+            arr[dest++] = tmp[cursor1++];
+            if (--len1 == 1)
+                goto done;
+            minGallop--;
+        } while (count1 >= MIN_GALLOP || count2 >= MIN_GALLOP);
+        if (minGallop < 0)
+            minGallop = 0;
+        minGallop += 2; // Penalize leaving galloping mode
+    }
+
+done:
+    ts->minGallop = minGallop < 1 ? 1 : minGallop;
+    if (len1 == 1) {
+        std::copy(arr + cursor2, arr + cursor2 + len2, arr + dest);
+        arr[dest + len2] = tmp[cursor1];
+    } else {
+        std::copy(tmp + cursor1, tmp + cursor1 + len1, arr + dest);
+    }
+}
+
+// Mirror image of mergeLo: merges right to left with the second (shorter)
+// run copied out to scratch
+static inline void mergeHi(timsort_state* ts, size_t base1, size_t len1, size_t base2, size_t len2)
+{
+    int32_t* arr = ts->arr;
+    int32_t* tmp = ts->tmp.buffer;
+    std::copy(arr + base2, arr + base2 + len2, tmp);
+
+    ptrdiff_t cursor1 = base1 + len1 - 1, cursor2 = len2 - 1, dest = base2 + len2 - 1;
+    arr[dest--] = arr[cursor1--];
+    if (--len1 == 0) {
+        std::copy(tmp, tmp + len2, arr + dest - (len2 - 1));
+        return;
+    }
+    if (len2 == 1) {
+        dest -= len1;
+        cursor1 -= len1;
+        std::copy_backward(arr + cursor1 + 1, arr + cursor1 + 1 + len1, arr + dest + 1 + len1);
+        arr[dest] = tmp[cursor2];
+        return;
+    }
+
+    ptrdiff_t minGallop = ts->minGallop;
+    while (true) {
+        size_t count1 = 0, count2 = 0;
+
+        do {
+            if (tmp[cursor2] < arr[cursor1]) {
+                arr[dest--] = arr[cursor1--];
+                count1++;
+                count2 = 0;
+                if (--len1 == 0)
+                    goto done;
+            } else {
+                arr[dest--] = tmp[cursor2--];
+                count2++;
+                count1 = 0;
+                if (--len2 == 1)
+                    goto done;
+            }
+        } while ((ptrdiff_t)(count1 | count2) < minGallop);
+
+        do {
+            count1 = len1 - gallopRight(tmp[cursor2], arr + base1, len1, len1 - 1);
+            if (count1 != 0) {
+                dest -= count1;
+                cursor1 -= count1;
+                len1 -= count1;
+                std::copy_backward(arr + cursor1 + 1, arr + cursor1 + 1 + count1, arr + dest + 1 + count1);
+                if (len1 == 0)
+                    goto done;
+            }
+            arr[dest--] = tmp[cursor2--];
+            if (--len2 == 1)
+                goto done;
+
+            count2 = len2 - gallopLeft(arr[cursor1], tmp, len2, len2 - 1);
+            if (count2 != 0) {
+                dest -= count2;
+                cursor2 -= count2;
+                len2 -= count2;
+                std::copy(tmp + cursor2 + 1, tmp + cursor2 + 1 + count2, arr + dest + 1);
+                if (len2 <= 1)
+                    goto done;
+            }
+            arr[dest--] = arr[cursor1--];
+            if (--len1 == 0)
+                goto done;
+            minGallop--;
+        } while (count1 >= MIN_GALLOP || count2 >= MIN_GALLOP);
+        if (minGallop < 0)
+            minGallop = 0;
+        minGallop += 2;
+    }
+
+done:
+    ts->minGallop = minGallop < 1 ? 1 : minGallop;
+    if (len2 == 1) {
+        dest -= len1;
+        cursor1 -= len1;
+        std::copy_backward(arr + cursor1 + 1, arr + cursor1 + 1 + len1, arr + dest + 1 + len1);
+        arr[dest] = tmp[cursor2];
+    } else {
+        std::copy(tmp, tmp + len2, arr + dest - (len2 - 1));
+    }
+}
+
+// Merges the adjacent sorted ranges a[0..len1) and a[len1..len1+len2)
+// without scratch: the longer range is cut in half, the shorter one at the
+// same rank, the two middle pieces are swapped with a rotation, and each
+// side is merged the same way. Stable, with O(n log n) moves; only used
+// when there's no scratch to merge through.
+static inline void mergeInPlace(int32_t* a, size_t len1, size_t len2)
+{
+    while (len1 > 0 && len2 > 0) {
+        if (len1 + len2 == 2) {
+            if (a[1] < a[0])
+                std::swap(a[0], a[1]);
+            return;
+        }
+        size_t cut1, cut2;
+        if (len1 >= len2) {
+            cut1 = len1 / 2;
+            cut2 = std::lower_bound(a + len1, a + len1 + len2, a[cut1]) - (a + len1);
+        } else {
+            cut2 = len2 / 2;
+            cut1 = std::upper_bound(a, a + len1, a[len1 + cut2]) - a;
+        }
+        std::rotate(a + cut1, a + len1, a + len1 + cut2);
+        // Recurse on the smaller side and loop on the larger, so the stack
+        // stays O(log n) deep
+        size_t const mid = cut1 + cut2;
+        if (2 * mid <= len1 + len2) {
+            mergeInPlace(a, cut1, cut2);
+            a += mid;
+            len1 -= cut1;
+            len2 -= cut2;
+        } else {
+            mergeInPlace(a + mid, len1 - cut1, len2 - cut2);
+            len1 = cut1;
+            len2 = cut2;
+        }
+    }
+}
+
+// Merge function merges the sorted runs at stack positions i and i + 1
+static inline void merge(timsort_state* ts, int i)
+{
+    size_t base1 = ts->runBase[i], len1 = ts->runLen[i];
+    size_t base2 = ts->runBase[i + 1], len2 = ts->runLen[i + 1];
+
+    ts->runLen[i] = len1 + len2;
+    if (i == ts->stackSize - 3) {
+        ts->runBase[i + 1] = ts->runBase[i + 2];
+        ts->runLen[i + 1] = ts->runLen[i + 2];
+    }
+    ts->stackSize--;
+
+    // Elements of run 1 that are already in place can be skipped
+    size_t k = gallopRight(ts->arr[base2], ts->arr + base1, len1, 0);
+    base1 += k;
+    len1 -= k;
+    if (len1 == 0)
+        return;
+
+    // Likewise elements at the end of run 2
+    len2 = gallopLeft(ts->arr[base1 + len1 - 1], ts->arr + base2, len2, len2 - 1);
+    if (len2 == 0)
+        return;
+
+    // The shorter run has to fit in scratch to be merged through it
+    if (std::min(len1, len2) > ts->tmp.capacity) {
+        mergeInPlace(ts->arr + base1, len1, len2);
+        return;
+    }
+
+    // Roughly balanced merges go through the AVX2 kernel; skewed ones are
+    // left to galloping, which can skip most of the longer run
+    if (simd_merge_available() && std::max(len1, len2) <= SIMD_MERGE_MAX_SKEW * std::min(len1, len2)) {
+        int32_t* tmp = ts->tmp.buffer;
+        if (len1 <= len2) {
+            std::copy(ts->arr + base1, ts->arr + base1 + len1, tmp);
+            merge_int32(tmp, len1, ts->arr + base2, len2, ts->arr + base1);
+        } else {
+            std::copy(ts->arr + base2, ts->arr + base2 + len2, tmp);
+            merge_int32_backward(ts->arr + base1, len1, tmp, len2, ts->arr + base1);
+        }
+        return;
+    }
+
+    if (len1 <= len2)
+        mergeLo(ts, base1, len1, base2, len2);
+    else
+        mergeHi(ts, base1, len1, base2, len2);
+}
+
+// Merges runs until the stack satisfies, for the top runs X, Y, Z, W:
+//   len(Y) > len(Z), len(X) > len(Y) + len(Z), len(W) > len(X) + len(Y)
+// which keeps the run lengths growing at least as fast as Fibonacci numbers
+static inline void mergeCollapse(timsort_state* ts)
+{
+    while (ts->stackSize > 1) {
+        int n = ts->stackSize - 2;
+        size_t* len = ts->runLen;
+        if ((n > 0 && len[n - 1] <= len[n] + len[n + 1]) ||
+            (n > 1 && len[n - 2] <= len[n] + len[n - 1])) {
+            if (len[n - 1] < len[n + 1])
+                n--;
+        } else if (len[n] > len[n + 1]) {
+            break;
+        }
+        merge(ts, n);
+    }
+}
+
+// Merges all remaining runs once the input is exhausted
+static inline void mergeForceCollapse(timsort_state* ts)
+{
+    while (ts->stackSize > 1) {
+        int n = ts->stackSize - 2;
+        if (n > 0 && ts->runLen[n - 1] < ts->runLen[n + 1])
+            n--;
+        merge(ts, n);
+    }
+}
+
+// Timsort function to sort the array[0...n-1]
+// Natural runs (descending ones reversed) are extended to minrun with binary
+// insertion, pushed on a stack, and merged as the stack invariants require.
+// Run is the tuned RUN (see sort_tuning.h).
+template <size_t Run>
+static inline void timSortWithRun(int32_t arr[], size_t n)
+{
+    if (n < 2)
+        return;
+
+    // Small arrays need no merging at all
+    if (n < Run) {
+        size_t initRunLen = countRunAndMakeAscending(arr, 0, n);
+        binaryInsertionSort(arr, 0, n, initRunLen);
+        return;
+    }
+
+    timsort_state ts;
+    ts.arr = arr;
+    ts.minGallop = MIN_GALLOP;
+    ts.stackSize = 0;
+    // mergeLo/mergeHi copy out the shorter run, which is never more than n/2.
+    // Without that much scratch merge() does every merge in place.
+    arena_init(&ts.tmp, n / 2);
+
+    size_t minRun = minRunLength<Run>(n);
+    size_t lo = 0, remaining = n;
+    do {
+        size_t runLen = countRunAndMakeAscending(arr, lo, n);
+
+        // Extend short runs to min(minRun, remaining). minRun never exceeds
+        // Run, so the sorting network can take the whole block; binary
+        // insertion is kept for CPUs without AVX2. The network is not stable,
+        // which only matters once keys carry payloads.
+        if (runLen < minRun) {
+            size_t force = std::min(remaining, minRun);
+            if (simd_sort_available())
+                sort_int32_network(arr + lo, force);
+            else
+                binaryInsertionSort(arr, lo, lo + force, lo + runLen);
+            runLen = force;
+        }
+
+        ts.runBase[ts.stackSize] = lo;
+        ts.runLen[ts.stackSize] = runLen;
+        ts.stackSize++;
+        mergeCollapse(&ts);
+
+        lo += runLen;
+        remaining -= runLen;
+    } while (remaining != 0);
+
+    mergeForceCollapse(&ts);
+    arena_free(&ts.tmp);
+}
+
+// timSortWithRun for one of sort_tuning.h's tuning_runs
+static inline void (*timsort_for_run(size_t run))(int32_t*, size_t)
+{
+    switch (run) {
+    case 16: return timSortWithRun<16>;
+    case 24: return timSortWithRun<24>;
+    case 48: return timSortWithRun<48>;
+    case 64: return timSortWithRun<64>;
+    default: return timSortWithRun<32>;
+    }
+}
+
+// timSort with the machine's tuned minimum run, picked on the first call
+static inline void timSort(int32_t arr[], size_t n)
+{
+    static void (*const tuned)(int32_t*, size_t) = timsort_for_run(sort_tuning_get().timsortRun);
+    tuned(arr, n);
+}
+
+// Multithreaded timSort on the shared pool (see sort_pool_init).
+// The array is cut into one segment per thread and each segment is
+// timSorted as a task, which keeps run detection and galloping within each
+// segment. The sorted segments are then merged pairwise in bottom-up
+// passes, the merges of one pass running side by side. Once a pass has
+// fewer merges than threads, each merge is also split at co-ranks. Ties
+// always go to the left segment, so the result is stable and matches
+// timSort's output exactly.
+static inline void parallelTimSort(int32_t arr[], size_t n)
+{
+    unsigned const threads = sort_pool->size();
+    // Segments smaller than the grain aren't worth a thread of their own
+    size_t const segments = std::min<size_t>(threads, n / sort_tuning_get().parallelTimSortGrain);
+    if (segments < 2) {
+        timSort(arr, n);
+        return;
+    }
+
+    std::vector<size_t> bounds(segments + 1);
+    for (size_t s = 0; s <= segments; s++)
+        bounds[s] = n * s / segments;
+
+    task_group group;
+    for (size_t s = 0; s < segments; s++)
+        sort_pool->spawn(group, [=, &bounds] { timSort(arr + bounds[s], bounds[s + 1] - bounds[s]); });
+    sort_pool->wait(group);
+
+    scratch_arena<int32_t> arena;
+    if (!arena_init(&arena, n)) {
+        // No scratch: merge neighbouring segments in place, one task per
+        // pair, until one is left
+        while (bounds.size() > 2) {
+            size_t const runs = bounds.size() - 1;
+            std::vector<size_t> merged;
+            for (size_t r = 0; r < runs; r += 2) {
+                merged.push_back(bounds[r]);
+                if (r + 2 > runs)
+                    continue;
+                size_t lo = bounds[r], mid = bounds[r + 1], hi = bounds[r + 2];
+                sort_pool->spawn(group, [=] { mergeInPlace(arr + lo, mid - lo, hi - mid); });
+            }
+            sort_pool->wait(group);
+            merged.push_back(n);
+            bounds.swap(merged);
+        }
+        return;
+    }
+    int32_t* src = arr;
+    int32_t* dst = arena.buffer;
+
+    while (bounds.size() > 2) {
+        size_t const runs = bounds.size() - 1;
+        size_t const merges = runs / 2;
+        unsigned const pieces = merges < threads ? (threads + merges - 1) / merges : 1;
+
+        std::vector<size_t> merged;
+        for (size_t r = 0; r < runs; r += 2) {
+            merged.push_back(bounds[r]);
+            size_t lo = bounds[r], mid = bounds[r + 1], hi = bounds[std::min(r + 2, runs)];
+            sort_pool->spawn(group, [=] {
+                if (mid == hi)
+                    std::copy(src + lo, src + hi, dst + lo); // Odd run out: carry it over
+                else
+                    parallel_merge_int32(src + lo, mid - lo, src + mid, hi - mid, dst + lo, pieces);
+            });
+        }
+        sort_pool->wait(group);
+        merged.push_back(n);
+        bounds.swap(merged);
+        std::swap(src, dst);
+    }
+
+    if (src != arr) {
+        for (unsigned t = 0; t < threads; t++) {
+            size_t lo = n * t / threads, hi = n * (t + 1) / threads;
+            sort_pool->spawn(group, [=] { std::copy(src + lo, src + hi, arr + lo); });
+        }
+        sort_pool->wait(group);
+    }
+    arena_free(&arena);
+}
+
+#endif
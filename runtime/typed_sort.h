@@ -0,0 +1,741 @@
+// Sorts for any key type and comparator. The comparator is a template
+// parameter (std::less<T> by default), so it is inlined into the loops
+// the same way the hard-coded < is in the 32-bit sorts:
+//   typed::merge_sort(a, n, comp)              stable, n extra elements
+//   typed::quick_sort(a, n, comp)              introsort, in place, not stable
+//   typed::tim_sort(a, n, comp)                stable, fast on presorted runs
+//   typed::inplace_merge_sort(a, n, comp)      stable, about sqrt(n) extra elements
+//   typed::argsort(keys, n, perm, comp)        stable sorting permutation
+//   typed::sort_by_key(keys, values, n, comp)  keys and payloads in two arrays
+// T must be trivially copyable; scratch comes from scratch_arena.h.
+// The int32 sorts in the other headers stay the fast path for 32-bit keys.
+#ifndef TYPED_SORT_H
+#define TYPED_SORT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <math.h>
+#include <algorithm>
+#include <functional>
+#include <type_traits>
+#include "scratch_arena.h"
+
+// Ranges at or below this size are finished with insertion sort
+#define TYPED_INSERTION_CUTOFF 24
+// Ranges above this size pick their pivot with Tukey's ninther
+#define TYPED_NINTHER_THRESHOLD 128
+// tim_sort's minimum run length is picked from [TYPED_MIN_MERGE/2, TYPED_MIN_MERGE]
+#define TYPED_MIN_MERGE 32
+#define TYPED_MIN_GALLOP 7
+#define TYPED_MAX_RUNS 85
+// tim_sort merges more lopsided than this gallop instead of merging branch-free
+#define TYPED_MERGE_MAX_SKEW 8
+
+namespace typed {
+
+// Stable insertion sort of a[0..n)
+template <typename T, typename Compare>
+void insertion_sort(T* a, size_t n, Compare comp) {
+    for (size_t i = 1; i < n; i++) {
+        T value = a[i];
+        size_t j = i;
+        for (; j > 0 && comp(value, a[j - 1]); j--)
+            a[j] = a[j - 1];
+        a[j] = value;
+    }
+}
+
+// Merges a[0..na) and b[0..nb) into out. Ties take from a, which keeps
+// the merge stable; the take is a select rather than a branch.
+template <typename T, typename Compare>
+void merge_runs(const T* a, size_t na, const T* b, size_t nb, T* out, Compare comp) {
+    size_t i = 0, j = 0, k = 0;
+    while (i < na && j < nb) {
+        bool const takeB = comp(b[j], a[i]);
+        out[k++] = takeB ? b[j] : a[i];
+        j += takeB;
+        i += !takeB;
+    }
+    std::copy(a + i, a + na, out + k);
+    std::copy(b + j, b + nb, out + k + (na - i));
+}
+
+// merge_runs from the back: fills out[0..na+nb) right to left, so b may be
+// the tail of out itself (as when timsort merges a run in place)
+template <typename T, typename Compare>
+void merge_runs_backward(const T* a, size_t na, const T* b, size_t nb, T* out, Compare comp) {
+    size_t i = na, j = nb, k = na + nb;
+    while (i > 0 && j > 0) {
+        bool const takeA = comp(b[j - 1], a[i - 1]);
+        out[--k] = takeA ? a[i - 1] : b[j - 1];
+        i -= takeA;
+        j -= !takeA;
+    }
+    std::copy_backward(a, a + i, out + k);
+    std::copy_backward(b, b + j, out + k - i);
+}
+
+// Sorts src[0..n) into dst[0..n); both must hold the same values on entry.
+// The buffers swap roles at every level, as in merge_sort.h.
+template <typename T, typename Compare>
+void merge_sort_into(T* src, T* dst, size_t n, Compare comp) {
+    if (n <= TYPED_INSERTION_CUTOFF) {
+        insertion_sort(dst, n, comp);
+        return;
+    }
+    size_t mid = n / 2;
+    merge_sort_into(dst, src, mid, comp);
+    merge_sort_into(dst + mid, src + mid, n - mid, comp);
+    // Halves that are already in order only need copying
+    if (!comp(src[mid], src[mid - 1]))
+        std::copy(src, src + n, dst);
+    else
+        merge_runs(src, mid, src + mid, n - mid, dst, comp);
+}
+
+// Stable top-down merge sort of a[0..n)
+template <typename T, typename Compare = std::less<T>>
+void merge_sort(T* a, size_t n, Compare comp = Compare()) {
+    static_assert(std::is_trivially_copyable<T>::value, "scratch buffers hold raw copies of T");
+    if (n < 2)
+        return;
+
+    scratch_arena<T> arena;
+    if (!arena_init(&arena, n)) {
+        std::stable_sort(a, a + n, comp);
+        return;
+    }
+    std::copy(a, a + n, arena.buffer);
+    merge_sort_into(arena.buffer, a, n, comp);
+    arena_free(&arena);
+}
+
+// Returns the index of the median of a[i], a[j] and a[k]
+template <typename T, typename Compare>
+size_t median_of_3(const T* a, size_t i, size_t j, size_t k, Compare comp) {
+    if (comp(a[i], a[j])) {
+        if (comp(a[j], a[k]))
+            return j;
+        return comp(a[i], a[k]) ? k : i;
+    }
+    if (comp(a[i], a[k]))
+        return i;
+    return comp(a[j], a[k]) ? k : j;
+}
+
+// Partitions a[0..n) around the median of 3 (ninther above
+// TYPED_NINTHER_THRESHOLD). Returns p with a[0..p) <= a[p] <= a[p+1..n).
+// Both scans stop on keys equal to the pivot, so runs of equal keys are
+// split evenly instead of all landing on one side.
+template <typename T, typename Compare>
+size_t partition_pivot(T* a, size_t n, Compare comp) {
+    size_t const mid = n / 2, last = n - 1;
+    size_t pivotIndex;
+    if (n <= TYPED_NINTHER_THRESHOLD) {
+        pivotIndex = median_of_3(a, 0, mid, last, comp);
+    } else {
+        size_t step = n / 8;
+        pivotIndex = median_of_3(a, median_of_3(a, 0, step, 2 * step, comp), median_of_3(a, mid - step, mid, mid + step, comp),
+                                 median_of_3(a, last - 2 * step, last - step, last, comp), comp);
+    }
+    std::swap(a[0], a[pivotIndex]);
+
+    T const pivot = a[0];
+    size_t i = 0, j = n;
+    while (true) {
+        while (++i < last && comp(a[i], pivot))
+            ;
+        while (comp(pivot, a[--j]))
+            ;   // Stops at a[0] at the latest
+        if (i >= j)
+            break;
+        std::swap(a[i], a[j]);
+    }
+    std::swap(a[0], a[j]);
+    return j;
+}
+
+// Recurses into the smaller side and loops on the larger one
+template <typename T, typename Compare>
+void quick_sort_loop(T* a, size_t n, int depthLimit, Compare comp) {
+    while (n > TYPED_INSERTION_CUTOFF) {
+        if (depthLimit == 0) {
+            std::make_heap(a, a + n, comp);
+            std::sort_heap(a, a + n, comp);
+            return;
+        }
+        depthLimit--;
+
+        size_t p = partition_pivot(a, n, comp);
+        if (p < n - p - 1) {
+            quick_sort_loop(a, p, depthLimit, comp);
+            a += p + 1;
+            n -= p + 1;
+        } else {
+            quick_sort_loop(a + p + 1, n - p - 1, depthLimit, comp);
+            n = p;
+        }
+    }
+    insertion_sort(a, n, comp);
+}
+
+// Introsort of a[0..n): quicksort that falls back to heapsort after
+// 2*log2(n) levels
+template <typename T, typename Compare = std::less<T>>
+void quick_sort(T* a, size_t n, Compare comp = Compare()) {
+    int depthLimit = 0;
+    for (size_t m = n; m > 1; m >>= 1)
+        depthLimit += 2;
+    quick_sort_loop(a, n, depthLimit, comp);
+}
+
+// Returns k such that a[k-1] < key <= a[k], searching outwards from a[hint]
+template <typename T, typename Compare>
+size_t gallop_left(const T& key, const T* a, size_t len, size_t hint, Compare comp) {
+    ptrdiff_t lastOfs = 0, ofs = 1;
+    if (comp(a[hint], key)) {
+        ptrdiff_t maxOfs = len - hint;
+        while (ofs < maxOfs && comp(a[hint + ofs], key)) {
+            lastOfs = ofs;
+            ofs = (ofs << 1) + 1;
+        }
+        if (ofs > maxOfs)
+            ofs = maxOfs;
+        lastOfs += hint;
+        ofs += hint;
+    } else {
+        ptrdiff_t maxOfs = hint + 1;
+        while (ofs < maxOfs && !comp(a[hint - ofs], key)) {
+            lastOfs = ofs;
+            ofs = (ofs << 1) + 1;
+        }
+        if (ofs > maxOfs)
+            ofs = maxOfs;
+        ptrdiff_t tmp = lastOfs;
+        lastOfs = hint - ofs;
+        ofs = hint - tmp;
+    }
+
+    lastOfs++;
+    while (lastOfs < ofs) {
+        ptrdiff_t m = lastOfs + ((ofs - lastOfs) >> 1);
+        if (comp(a[m], key))
+            lastOfs = m + 1;
+        else
+            ofs = m;
+    }
+    return ofs;
+}
+
+// Returns k such that a[k-1] <= key < a[k], searching outwards from a[hint]
+template <typename T, typename Compare>
+size_t gallop_right(const T& key, const T* a, size_t len, size_t hint, Compare comp) {
+    ptrdiff_t lastOfs = 0, ofs = 1;
+    if (comp(key, a[hint])) {
+        ptrdiff_t maxOfs = hint + 1;
+        while (ofs < maxOfs && comp(key, a[hint - ofs])) {
+            lastOfs = ofs;
+            ofs = (ofs << 1) + 1;
+        }
+        if (ofs > maxOfs)
+            ofs = maxOfs;
+        ptrdiff_t tmp = lastOfs;
+        lastOfs = hint - ofs;
+        ofs = hint - tmp;
+    } else {
+        ptrdiff_t maxOfs = len - hint;
+        while (ofs < maxOfs && !comp(key, a[hint + ofs])) {
+            lastOfs = ofs;
+            ofs = (ofs << 1) + 1;
+        }
+        if (ofs > maxOfs)
+            ofs = maxOfs;
+        lastOfs += hint;
+        ofs += hint;
+    }
+
+    lastOfs++;
+    while (lastOfs < ofs) {
+        ptrdiff_t m = lastOfs + ((ofs - lastOfs) >> 1);
+        if (comp(key, a[m]))
+            ofs = m;
+        else
+            lastOfs = m + 1;
+    }
+    return ofs;
+}
+
+// Pending runs and merge scratch for one tim_sort call
+template <typename T, typename Compare>
+struct tim_state {
+    T* arr;
+    scratch_arena<T> tmp;
+    Compare comp;
+    ptrdiff_t minGallop;
+    size_t runBase[TYPED_MAX_RUNS];
+    size_t runLen[TYPED_MAX_RUNS];
+    int stackSize;
+};
+
+// timsort.h's mergeLo with the comparator: merges left to right with the
+// first (shorter) run copied out. arr[base2] belongs first and the last
+// key of the first run belongs last.
+template <typename T, typename Compare>
+void tim_merge_lo(tim_state<T, Compare>* ts, size_t base1, size_t len1, size_t base2, size_t len2) {
+    T* arr = ts->arr;
+    T* tmp = ts->tmp.buffer;
+    Compare comp = ts->comp;
+    std::copy(arr + base1, arr + base1 + len1, tmp);
+
+    size_t cursor1 = 0, cursor2 = base2, dest = base1;
+    arr[dest++] = arr[cursor2++];
+    if (--len2 == 0) {
+        std::copy(tmp + cursor1, tmp + cursor1 + len1, arr + dest);
+        return;
+    }
+    if (len1 == 1) {
+        std::copy(arr + cursor2, arr + cursor2 + len2, arr + dest);
+        arr[dest + len2] = tmp[cursor1];
+        return;
+    }
+
+    ptrdiff_t minGallop = ts->minGallop;
+    while (true) {
+        size_t count1 = 0, count2 = 0;
+
+        do {
+            if (comp(arr[cursor2], tmp[cursor1])) {
+                arr[dest++] = arr[cursor2++];
+                count2++;
+                count1 = 0;
+                if (--len2 == 0)
+                    goto done;
+            } else {
+                arr[dest++] = tmp[cursor1++];
+                count1++;
+                count2 = 0;
+                if (--len1 == 1)
+                    goto done;
+            }
+        } while ((ptrdiff_t)(count1 | count2) < minGallop);
+
+        do {
+            count1 = gallop_right(arr[cursor2], tmp + cursor1, len1, 0, comp);
+            if (count1 != 0) {
+                std::copy(tmp + cursor1, tmp + cursor1 + count1, arr + dest);
+                dest += count1;
+                cursor1 += count1;
+                len1 -= count1;
+                if (len1 <= 1)
+                    goto done;
+            }
+            arr[dest++] = arr[cursor2++];
+            if (--len2 == 0)
+                goto done;
+
+            count2 = gallop_left(tmp[cursor1], arr + cursor2, len2, 0, comp);
+            if (count2 != 0) {
+                std::copy(arr + cursor2, arr + cursor2 + count2, arr + dest);
+                dest += count2;
+                cursor2 += count2;
+                len2 -= count2;
+                if (len2 == 0)
+                    goto done;
+            }
+            arr[dest++] = tmp[cursor1++];
+            if (--len1 == 1)
+                goto done;
+            minGallop--;
+        } while (count1 >= TYPED_MIN_GALLOP || count2 >= TYPED_MIN_GALLOP);
+        if (minGallop < 0)
+            minGallop = 0;
+        minGallop += 2;
+    }
+
+done:
+    ts->minGallop = minGallop < 1 ? 1 : minGallop;
+    if (len1 == 1) {
+        std::copy(arr + cursor2, arr + cursor2 + len2, arr + dest);
+        arr[dest + len2] = tmp[cursor1];
+    } else {
+        std::copy(tmp + cursor1, tmp + cursor1 + len1, arr + dest);
+    }
+}
+
+// Mirror image of tim_merge_lo, with the second (shorter) run copied out
+template <typename T, typename Compare>
+void tim_merge_hi(tim_state<T, Compare>* ts, size_t base1, size_t len1, size_t base2, size_t len2) {
+    T* arr = ts->arr;
+    T* tmp = ts->tmp.buffer;
+    Compare comp = ts->comp;
+    std::copy(arr + base2, arr + base2 + len2, tmp);
+
+    ptrdiff_t cursor1 = base1 + len1 - 1, cursor2 = len2 - 1, dest = base2 + len2 - 1;
+    arr[dest--] = arr[cursor1--];
+    if (--len1 == 0) {
+        std::copy(tmp, tmp + len2, arr + dest - (len2 - 1));
+        return;
+    }
+    if (len2 == 1) {
+        dest -= len1;
+        cursor1 -= len1;
+        std::copy_backward(arr + cursor1 + 1, arr + cursor1 + 1 + len1, arr + dest + 1 + len1);
+        arr[dest] = tmp[cursor2];
+        return;
+    }
+
+    ptrdiff_t minGallop = ts->minGallop;
+    while (true) {
+        size_t count1 = 0, count2 = 0;
+
+        do {
+            if (comp(tmp[cursor2], arr[cursor1])) {
+                arr[dest--] = arr[cursor1--];
+                count1++;
+                count2 = 0;
+                if (--len1 == 0)
+                    goto done;
+            } else {
+                arr[dest--] = tmp[cursor2--];
+                count2++;
+                count1 = 0;
+                if (--len2 == 1)
+                    goto done;
+            }
+        } while ((ptrdiff_t)(count1 | count2) < minGallop);
+
+        do {
+            count1 = len1 - gallop_right(tmp[cursor2], arr + base1, len1, len1 - 1, comp);
+            if (count1 != 0) {
+                dest -= count1;
+                cursor1 -= count1;
+                len1 -= count1;
+                std::copy_backward(arr + cursor1 + 1, arr + cursor1 + 1 + count1, arr + dest + 1 + count1);
+                if (len1 == 0)
+                    goto done;
+            }
+            arr[dest--] = tmp[cursor2--];
+            if (--len2 == 1)
+                goto done;
+
+            count2 = len2 - gallop_left(arr[cursor1], tmp, len2, len2 - 1, comp);
+            if (count2 != 0) {
+                dest -= count2;
+                cursor2 -= count2;
+                len2 -= count2;
+                std::copy(tmp + cursor2 + 1, tmp + cursor2 + 1 + count2, arr + dest + 1);
+                if (len2 <= 1)
+                    goto done;
+            }
+            arr[dest--] = arr[cursor1--];
+            if (--len1 == 0)
+                goto done;
+            minGallop--;
+        } while (count1 >= TYPED_MIN_GALLOP || count2 >= TYPED_MIN_GALLOP);
+        if (minGallop < 0)
+            minGallop = 0;
+        minGallop += 2;
+    }
+
+done:
+    ts->minGallop = minGallop < 1 ? 1 : minGallop;
+    if (len2 == 1) {
+        dest -= len1;
+        cursor1 -= len1;
+        std::copy_backward(arr + cursor1 + 1, arr + cursor1 + 1 + len1, arr + dest + 1 + len1);
+        arr[dest] = tmp[cursor2];
+    } else {
+        std::copy(tmp, tmp + len2, arr + dest - (len2 - 1));
+    }
+}
+
+// Merges the runs at stack positions i and i + 1
+template <typename T, typename Compare>
+void tim_merge_at(tim_state<T, Compare>* ts, int i) {
+    size_t base1 = ts->runBase[i], len1 = ts->runLen[i];
+    size_t base2 = ts->runBase[i + 1], len2 = ts->runLen[i + 1];
+
+    ts->runLen[i] = len1 + len2;
+    if (i == ts->stackSize - 3) {
+        ts->runBase[i + 1] = ts->runBase[i + 2];
+        ts->runLen[i + 1] = ts->runLen[i + 2];
+    }
+    ts->stackSize--;
+
+    // Keys of run 1 already in place, and likewise at the end of run 2
+    size_t k = gallop_right(ts->arr[base2], ts->arr + base1, len1, 0, ts->comp);
+    base1 += k;
+    len1 -= k;
+    if (len1 == 0)
+        return;
+    len2 = gallop_left(ts->arr[base1 + len1 - 1], ts->arr + base2, len2, len2 - 1, ts->comp);
+    if (len2 == 0)
+        return;
+
+    // Roughly balanced merges take the branchless merge; skewed ones are
+    // left to galloping, which can skip most of the longer run
+    if (std::max(len1, len2) <= TYPED_MERGE_MAX_SKEW * std::min(len1, len2)) {
+        T* arr = ts->arr;
+        T* tmp = ts->tmp.buffer;
+        if (len1 <= len2) {
+            std::copy(arr + base1, arr + base1 + len1, tmp);
+            merge_runs(tmp, len1, arr + base2, len2, arr + base1, ts->comp);
+        } else {
+            std::copy(arr + base2, arr + base2 + len2, tmp);
+            merge_runs_backward(arr + base1, len1, tmp, len2, arr + base1, ts->comp);
+        }
+        return;
+    }
+
+    if (len1 <= len2)
+        tim_merge_lo(ts, base1, len1, base2, len2);
+    else
+        tim_merge_hi(ts, base1, len1, base2, len2);
+}
+
+// Stable timsort of a[0..n): natural runs (strictly descending ones
+// reversed) are extended to a minimum length with binary insertion and
+// merged under the same stack invariants as timSort in timsort.h
+template <typename T, typename Compare = std::less<T>>
+void tim_sort(T* a, size_t n, Compare comp = Compare()) {
+    static_assert(std::is_trivially_copyable<T>::value, "scratch buffers hold raw copies of T");
+    if (n < 2)
+        return;
+
+    size_t minRun = n, r = 0;
+    while (minRun >= TYPED_MIN_MERGE) {
+        r |= minRun & 1;
+        minRun >>= 1;
+    }
+    minRun += r;
+
+    // Brace-initialised because lambdas can't be default constructed
+    tim_state<T, Compare> ts{ a, scratch_arena<T>{ NULL, 0 }, comp, TYPED_MIN_GALLOP, {}, {}, 0 };
+    if (n >= TYPED_MIN_MERGE && !arena_init(&ts.tmp, n / 2)) {
+        std::stable_sort(a, a + n, comp);
+        return;
+    }
+
+    size_t lo = 0;
+    while (lo < n) {
+        size_t hi = lo + 1;
+        if (hi < n) {
+            if (comp(a[hi++], a[lo])) {
+                while (hi < n && comp(a[hi], a[hi - 1]))
+                    hi++;
+                std::reverse(a + lo, a + hi);
+            } else {
+                while (hi < n && !comp(a[hi], a[hi - 1]))
+                    hi++;
+            }
+        }
+
+        // Binary insertion of the keys after the natural run, inserting
+        // after equal keys to stay stable
+        size_t runEnd = std::min(n, std::max(hi, lo + minRun));
+        for (; hi < runEnd; hi++) {
+            T value = a[hi];
+            size_t pos = std::upper_bound(a + lo, a + hi, value, comp) - a;
+            std::copy_backward(a + pos, a + hi, a + hi + 1);
+            a[pos] = value;
+        }
+
+        ts.runBase[ts.stackSize] = lo;
+        ts.runLen[ts.stackSize] = runEnd - lo;
+        ts.stackSize++;
+        lo = runEnd;
+
+        // Restore the invariants of timsort.h's mergeCollapse
+        while (ts.stackSize > 1) {
+            int m = ts.stackSize - 2;
+            size_t* len = ts.runLen;
+            if ((m > 0 && len[m - 1] <= len[m] + len[m + 1]) || (m > 1 && len[m - 2] <= len[m] + len[m - 1])) {
+                if (len[m - 1] < len[m + 1])
+                    m--;
+            } else if (len[m] > len[m + 1]) {
+                break;
+            }
+            tim_merge_at(&ts, m);
+        }
+    }
+
+    while (ts.stackSize > 1) {
+        int m = ts.stackSize - 2;
+        if (m > 0 && ts.runLen[m - 1] < ts.runLen[m + 1])
+            m--;
+        tim_merge_at(&ts, m);
+    }
+    if (n >= TYPED_MIN_MERGE)
+        arena_free(&ts.tmp);
+}
+
+// Swaps the adjacent blocks a[0..na) and a[na..na+nb), moving the shorter
+// one through buffer[0..k) when it fits
+template <typename T>
+void rotate_blocks(T* a, size_t na, size_t nb, T* buffer, size_t k) {
+    if (na <= nb && na <= k) {
+        std::copy(a, a + na, buffer);
+        std::copy(a + na, a + na + nb, a);
+        std::copy(buffer, buffer + na, a + nb);
+    } else if (nb <= k) {
+        std::copy(a + na, a + na + nb, buffer);
+        std::copy_backward(a, a + na, a + na + nb);
+        std::copy(buffer, buffer + nb, a);
+    } else {
+        std::rotate(a, a + na, a + na + nb);
+    }
+}
+
+// Stably merges the adjacent runs a[0..na) and a[na..na+nb) with only
+// buffer[0..k) to spare. A merge whose shorter run fits the buffer is done
+// through it in one pass; a longer one is cut in two by rotating the middle
+// of the array (SymMerge), recursing into the smaller part.
+template <typename T, typename Compare>
+void merge_in_place(T* a, size_t na, size_t nb, T* buffer, size_t k, Compare comp) {
+    while (na > 0 && nb > 0) {
+        // Keys of the first run up to b[0], and of the second run from the
+        // first run's last key on, are already where they belong
+        size_t const skip = std::upper_bound(a, a + na, a[na], comp) - a;
+        a += skip;
+        na -= skip;
+        if (na == 0)
+            return;
+        nb = std::lower_bound(a + na, a + na + nb, a[na - 1], comp) - (a + na);
+
+        if (na <= nb && na <= k) {
+            std::copy(a, a + na, buffer);
+            merge_runs(buffer, na, a + na, nb, a, comp);
+            return;
+        }
+        if (nb <= k) {
+            std::copy(a + na, a + na + nb, buffer);
+            merge_runs_backward(a, na, buffer, nb, a, comp);
+            return;
+        }
+
+        // Cut the longer run in half and the other where that key belongs:
+        // a[0..cutA) and b[0..cutB) are at most the key, the rest at least
+        size_t cutA, cutB;
+        if (na >= nb) {
+            cutA = na / 2;
+            cutB = std::lower_bound(a + na, a + na + nb, a[cutA], comp) - (a + na);
+        } else {
+            cutB = nb / 2;
+            cutA = std::upper_bound(a, a + na, a[na + cutB], comp) - a;
+        }
+        rotate_blocks(a + cutA, na - cutA, cutB, buffer, k);
+
+        T* right = a + cutA + cutB;
+        if (cutA + cutB <= na + nb - cutA - cutB) {
+            merge_in_place(a, cutA, cutB, buffer, k, comp);
+            a = right;
+            na -= cutA;
+            nb -= cutB;
+        } else {
+            merge_in_place(right, na - cutA, nb - cutB, buffer, k, comp);
+            na = cutA;
+            nb = cutB;
+        }
+    }
+}
+
+// Stable merge sort of a[0..n) for when n extra elements are too many: a
+// buffer of about sqrt(n) elements serves the bottom-up merges, which are
+// ordinary one-pass merges until the runs outgrow it. If even that can't be
+// allocated, every merge is done by rotation alone.
+template <typename T, typename Compare = std::less<T>>
+void inplace_merge_sort(T* a, size_t n, Compare comp = Compare()) {
+    static_assert(std::is_trivially_copyable<T>::value, "the buffer holds raw copies of T");
+    if (n < 2)
+        return;
+
+    scratch_arena<T> arena;
+    size_t k = std::max<size_t>((size_t)sqrt((double)n), TYPED_INSERTION_CUTOFF);
+    if (!arena_init(&arena, k))
+        k = 0;
+
+    for (size_t lo = 0; lo < n; lo += TYPED_INSERTION_CUTOFF)
+        insertion_sort(a + lo, std::min<size_t>(TYPED_INSERTION_CUTOFF, n - lo), comp);
+    for (size_t width = TYPED_INSERTION_CUTOFF; width < n; width *= 2)
+        for (size_t lo = 0; lo + width < n; lo += 2 * width)
+            merge_in_place(a + lo, width, std::min(width, n - lo - width), arena.buffer, k, comp);
+    arena_free(&arena);
+}
+
+// A key and where it came from, sorted in place of the (possibly much
+// larger) record it belongs to
+template <typename K, typename Index>
+struct keyed_index {
+    K key;
+    Index index;
+};
+
+// Stable-sorts (key, index) pairs for keys[0..n) into pairs[0..n)
+template <typename K, typename Index, typename Compare>
+void sort_key_index(const K* keys, size_t n, keyed_index<K, Index>* pairs, Compare comp) {
+    for (size_t i = 0; i < n; i++)
+        pairs[i] = keyed_index<K, Index>{ keys[i], (Index)i };
+    merge_sort(pairs, n, [comp](const keyed_index<K, Index>& x, const keyed_index<K, Index>& y) { return comp(x.key, y.key); });
+}
+
+template <typename K, typename Index, typename Compare>
+bool argsort_with(const K* keys, size_t n, size_t* perm, Compare comp) {
+    scratch_arena<keyed_index<K, Index>> pairs;
+    if (!arena_init(&pairs, n))
+        return false;
+    sort_key_index(keys, n, pairs.buffer, comp);
+    for (size_t i = 0; i < n; i++)
+        perm[i] = pairs.buffer[i].index;
+    arena_free(&pairs);
+    return true;
+}
+
+// Writes to perm[0..n) the permutation that sorts keys[0..n) stably:
+// keys[perm[0]] <= keys[perm[1]] <= ... The keys are left as they are.
+// Returns false if scratch can't be allocated.
+template <typename K, typename Compare = std::less<K>>
+bool argsort(const K* keys, size_t n, size_t* perm, Compare comp = Compare()) {
+    // 32-bit indices keep the pairs small whenever they are enough
+    if (n <= UINT32_MAX)
+        return argsort_with<K, uint32_t>(keys, n, perm, comp);
+    return argsort_with<K, uint64_t>(keys, n, perm, comp);
+}
+
+template <typename K, typename V, typename Index, typename Compare>
+bool sort_by_key_with(K* keys, V* values, size_t n, Compare comp) {
+    scratch_arena<keyed_index<K, Index>> pairs;
+    scratch_arena<V> moved;
+    if (!arena_init(&pairs, n))
+        return false;
+    if (!arena_init(&moved, n)) {
+        arena_free(&pairs);
+        return false;
+    }
+
+    sort_key_index(keys, n, pairs.buffer, comp);
+    for (size_t i = 0; i < n; i++) {
+        keys[i] = pairs.buffer[i].key;
+        moved.buffer[i] = values[pairs.buffer[i].index];
+    }
+    std::copy(moved.buffer, moved.buffer + n, values);
+    arena_free(&moved);
+    arena_free(&pairs);
+    return true;
+}
+
+// Stable sort of keys[0..n), applying the same permutation to values[0..n).
+// Only (key, index) pairs take part in the compares and merges, so a
+// large payload is moved once at the end instead of at every merge level.
+// Returns false (leaving both arrays as they were) if scratch can't be
+// allocated.
+template <typename K, typename V, typename Compare = std::less<K>>
+bool sort_by_key(K* keys, V* values, size_t n, Compare comp = Compare()) {
+    static_assert(std::is_trivially_copyable<V>::value, "scratch buffers hold raw copies of V");
+    if (n <= UINT32_MAX)
+        return sort_by_key_with<K, V, uint32_t>(keys, values, n, comp);
+    return sort_by_key_with<K, V, uint64_t>(keys, values, n, comp);
+}
+
+} // namespace typed
+
+#endif